@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Copies the icons named in LIST out of the icon themes THEME_DIR... into
+# OUTPUT_DIR and prints a gresource description for them on stdout.
+#
+# usage: extract-icons.sh LIST OUTPUT_DIR THEME_DIR...
+#
+# Without THEME_DIR the gresource is empty and every icon is looked up at
+# runtime.
+
+set -e
+
+list="$1"
+output="$2"
+shift 2
+
+mkdir -p "$output"
+
+echo '<?xml version="1.0" encoding="UTF-8"?>'
+echo '<gresources>'
+echo '	<gresource prefix="/kr/gooroom/greeter/icons">'
+
+test $# -gt 0 || list=/dev/null
+
+for name in $(grep -v '^#' "$list"); do
+	found=
+	for theme in "$@"; do
+		test -d "$theme" || continue
+		# Prefer scalable and symbolic directories, then the largest fixed size
+		found=$(find -L "$theme" -name "$name.svg" 2>/dev/null | \
+		        awk '{ p = 0; if ($0 ~ /symbolic|scalable/) p = 1000;
+		               else if (match ($0, /[0-9]+x?[0-9]*/)) p = substr ($0, RSTART, RLENGTH) + 0;
+		               print p "\t" $0 }' | \
+		        sort -rn | head -n 1 | cut -f 2)
+		test -n "$found" && break
+	done
+
+	if test -z "$found"; then
+		echo "extract-icons: $name not found, it will be looked up at runtime" >&2
+		continue
+	fi
+
+	cp -L "$found" "$output/$name.svg"
+	echo "		<file compressed=\"true\" alias=\"$name.svg\">$output/$name.svg</file>"
+done
+
+echo '	</gresource>'
+echo '</gresources>'
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+#
+# This program is free software: you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later
+# version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+# license.
+#
+
+"""Extracts the rules the greeter needs out of a GTK 3 theme.
+
+Prints the theme's gtk.css, with its imports inlined, keeping only the
+selectors made of the CSS nodes and style classes the greeter shows: those
+named in LIST and those of the .ui files. Colors and keyframes are kept
+whole, and the images the kept rules refer to are inlined as data: URLs, as
+the theme's own resources are not loaded with the bundled theme. The result
+is the base of the bundled theme (theme-mode=bundled).
+
+Images in the theme's gtk.gresource are read with gresource(1), or the
+program named by $GRESOURCE.
+
+usage: extract-theme.py LIST THEME_DIR UI_FILE...
+"""
+
+import base64
+import os
+import posixpath
+import re
+import subprocess
+import sys
+import xml.etree.ElementTree as ElementTree
+
+# CSS node of each widget type the .ui files use
+WIDGET_NODES = {
+    "GtkAlignment": [],
+    "GtkBox": ["box"],
+    "GtkButton": ["button"],
+    "GtkButtonBox": ["box"],
+    "GtkDialog": ["dialog"],
+    "GtkEntry": ["entry"],
+    "GtkImage": ["image"],
+    "GtkLabel": ["label"],
+    "GtkOverlay": ["overlay"],
+    "GtkSpinner": ["spinner"],
+    "GtkSwitch": ["switch", "slider"],
+    "GtkWindow": ["window"],
+}
+
+COMMENT_RE = re.compile(r"/\*.*?\*/", re.S)
+IMPORT_RE = re.compile(r"@import\s+url\(\s*[\"']?(?P<url>[^\"')]+)[\"']?\s*\)\s*;")
+# :not(.foo) or :nth-child(2n) do not name what the selector applies to
+PSEUDO_ARGS_RE = re.compile(r":[\w-]+\([^)]*\)")
+COMBINATOR_RE = re.compile(r"\s*[>+~]\s*|\s+")
+ELEMENT_RE = re.compile(r"^(?:\*|[A-Za-z_][\w-]*)")
+CLASS_RE = re.compile(r"\.([\w-]+)")
+URL_RE = re.compile(r"url\(\s*[\"']?(?P<url>[^\"')]+)[\"']?\s*\)")
+
+MIME_TYPES = {".png": "image/png", ".svg": "image/svg+xml"}
+
+
+class ExtractError(Exception):
+    pass
+
+
+def read_list(path):
+    nodes, classes = set(), set()
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            if line.startswith("."):
+                classes.add(line[1:])
+            else:
+                nodes.add(line)
+    return nodes, classes
+
+
+def read_ui(path, nodes, classes):
+    for element in ElementTree.parse(path).iter():
+        if element.tag in ("object", "template"):
+            widget = element.get("parent" if element.tag == "template" else "class")
+            if widget not in WIDGET_NODES:
+                raise ExtractError("%s: add the CSS node of %s to WIDGET_NODES" % (path, widget))
+            nodes.update(WIDGET_NODES[widget])
+        elif element.tag == "class" and element.get("name"):
+            classes.add(element.get("name"))
+
+
+def absolute(url, base):
+    """@url made absolute, relative to the stylesheet at @base"""
+    if re.match(r"^[a-z]+:", url):
+        return url
+    if base.startswith("resource://"):
+        return "resource://" + posixpath.normpath(posixpath.join(
+            posixpath.dirname(base[len("resource://"):]), url))
+    return "file://" + os.path.normpath(os.path.join(os.path.dirname(base[len("file://"):]), url))
+
+
+def fetch(url, theme_dir):
+    if url.startswith("resource://"):
+        bundle = os.path.join(theme_dir, "gtk.gresource")
+        try:
+            return subprocess.check_output([os.environ.get("GRESOURCE", "gresource"), "extract", bundle,
+                                            url[len("resource://"):]])
+        except (OSError, subprocess.CalledProcessError) as error:
+            raise ExtractError("%s: %s" % (url, error))
+    with open(url[len("file://"):], "rb") as f:
+        return f.read()
+
+
+def load(url, theme_dir):
+    """Contents of the stylesheet at @url, with its imports inlined and
+    the URLs it refers to made absolute"""
+    css = COMMENT_RE.sub("", fetch(url, theme_dir).decode("utf-8"))
+    css = URL_RE.sub(lambda match: 'url("%s")' % absolute(match.group("url"), url), css)
+    return IMPORT_RE.sub(lambda match: load(match.group("url"), theme_dir), css)
+
+
+def inline(declaration, theme_dir):
+    def data_url(match):
+        url = match.group("url")
+        if url.startswith("data:"):
+            return match.group(0)
+        mime_type = MIME_TYPES.get(os.path.splitext(url)[1])
+        if not mime_type:
+            raise ExtractError("%s: unknown image type" % url)
+        return 'url("data:%s;base64,%s")' % (mime_type,
+                                             base64.b64encode(fetch(url, theme_dir)).decode("ascii"))
+    return URL_RE.sub(data_url, declaration)
+
+
+def statements(css):
+    """Top level statements: (prelude, block) with block None for @rules
+    ending in a semicolon"""
+    i, start, length = 0, 0, len(css)
+    while i < length:
+        char = css[i]
+        if char == ";":
+            yield css[start:i].strip(), None
+            start = i + 1
+        elif char == "{":
+            depth, j = 1, i + 1
+            while j < length and depth:
+                if css[j] == "{":
+                    depth += 1
+                elif css[j] == "}":
+                    depth -= 1
+                j += 1
+            if depth:
+                raise ExtractError("unbalanced braces after \"%s\"" % css[start:i].strip())
+            yield css[start:i].strip(), css[i + 1:j - 1]
+            i = start = j
+            continue
+        i += 1
+
+
+def split_selectors(prelude):
+    selectors, depth, start = [], 0, 0
+    for i, char in enumerate(prelude):
+        if char == "(":
+            depth += 1
+        elif char == ")":
+            depth -= 1
+        elif char == "," and depth == 0:
+            selectors.append(prelude[start:i].strip())
+            start = i + 1
+    selectors.append(prelude[start:].strip())
+    return [s for s in selectors if s]
+
+
+def wanted(selector, nodes, classes):
+    selector = PSEUDO_ARGS_RE.sub("", selector)
+    for compound in COMBINATOR_RE.split(selector):
+        if not compound:
+            continue
+        if "#" in compound or "[" in compound:
+            return False
+        element = ELEMENT_RE.match(compound)
+        if element and element.group(0) != "*" and element.group(0) not in nodes:
+            return False
+        if any(name not in classes for name in CLASS_RE.findall(compound)):
+            return False
+    return True
+
+
+def extract(css, theme_dir, nodes, classes):
+    output, kept, dropped = [], 0, 0
+    for prelude, block in statements(css):
+        if prelude.startswith("@"):
+            if block is None:
+                if prelude.startswith("@define-color"):
+                    output.append(prelude + ";")
+            elif prelude.startswith("@keyframes"):
+                output.append("%s {%s}" % (prelude, block))
+            continue
+
+        selectors = [s for s in split_selectors(prelude) if wanted(s, nodes, classes)]
+        if not selectors:
+            dropped += 1
+            continue
+        kept += 1
+        declarations = [inline(d.strip(), theme_dir) for d in block.split(";") if d.strip()]
+        output.append("%s {\n  %s; }" % (",\n".join(selectors), ";\n  ".join(declarations)))
+
+    return output, kept, dropped
+
+
+def main(argv):
+    if len(argv) < 3:
+        print(__doc__.strip().splitlines()[-1], file=sys.stderr)
+        return 2
+
+    list_path, theme_dir, ui_files = argv[0], argv[1], argv[2:]
+    try:
+        nodes, classes = read_list(list_path)
+        for path in ui_files:
+            read_ui(path, nodes, classes)
+        gtk_css = "file://" + os.path.abspath(os.path.join(theme_dir, "gtk.css"))
+        output, kept, dropped = extract(load(gtk_css, theme_dir), theme_dir, nodes, classes)
+    except (ExtractError, OSError, ElementTree.ParseError) as error:
+        print("extract-theme: %s" % error, file=sys.stderr)
+        return 1
+
+    print("/*\n"
+          "Base rules of the GooroomGreeter theme, extracted from %s by\n"
+          "extract-theme.py: %d of %d rules are kept.\n"
+          "*/\n" % (theme_dir, kept, kept + dropped))
+    print("\n\n".join(output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -31,47 +31,30 @@
 #include "greeter-window.h"
 #include "greeterbackground.h"
 #include "greeterconfiguration.h"
+#include "greeter-profile.h"
+#include "greeter-watchdog.h"
+#include "greeter-spinner.h"
+#include "greeter-monitor-topology.h"
+#include "greeter-a11y.h"
+#include "greeter-memory.h"
 
 
+#define GREETER_THEME_NAME "GooroomGreeter"
+
 static GtkWidget *greeter_window = NULL;
 static GreeterBackground *greeter_background = NULL;
 
-struct SavedFocusData
-{
-	GtkWidget *widget;
-	gint editable_pos;
-};
-
-gpointer greeter_save_focus    (GtkWidget* widget);
-void     greeter_restore_focus (const gpointer saved_data);
-
-
-
-void
-greeter_restore_focus (const gpointer saved_data)
-{
-	struct SavedFocusData *data = saved_data;
-
-	if (!saved_data || !GTK_IS_WIDGET (data->widget))
-		return;
-
-	gtk_widget_grab_focus (data->widget);
-	if (GTK_IS_EDITABLE(data->widget) && data->editable_pos > -1)
-		gtk_editable_set_position(GTK_EDITABLE(data->widget), data->editable_pos);
-}
-
-gpointer
-greeter_save_focus (GtkWidget* widget)
+static gboolean
+sigusr1_cb (gpointer user_data)
 {
-	GtkWidget *window = gtk_widget_get_toplevel(widget);
-	if (!GTK_IS_WINDOW (window))
-	return NULL;
+	greeter_profile_report_frames ();
+	greeter_profile_report_objects ();
+	greeter_memory_report ();
 
-	struct SavedFocusData *data = g_new0 (struct SavedFocusData, 1);
-	data->widget = gtk_window_get_focus (GTK_WINDOW (window));
-	data->editable_pos = GTK_IS_EDITABLE(data->widget) ? gtk_editable_get_position (GTK_EDITABLE (data->widget)) : -1;
+	if (greeter_window)
+		greeter_window_report_indicators (GREETER_WINDOW (greeter_window));
 
-	return data;
+	return G_SOURCE_CONTINUE;
 }
 
 static void
@@ -278,6 +261,54 @@ apply_gtk_config (void)
 	g_key_file_free (keyfile);
 }
 
+/* Styles are in place before the first widget is built, so nothing has to
+ * be restyled when they arrive. In bundled mode the greeter's own
+ * GooroomGreeter theme, which already ends with theme.css, replaces the
+ * configured GTK theme for this process only; children keep reading
+ * settings.ini. */
+static void
+load_theme (GdkScreen *screen)
+{
+	gchar *mode;
+	gint64 start_time;
+	gboolean bundled;
+	GtkSettings *settings;
+
+	start_time = greeter_profile_enabled () ? g_get_monotonic_time () : 0;
+
+	mode = config_get_string (NULL, CONFIG_KEY_THEME_MODE, "full");
+	bundled = g_strcmp0 (mode, "bundled") == 0 && !g_getenv ("GTK_THEME");
+
+	if (bundled) {
+		/* GtkSettings parses the theme as soon as it exists; keep it from
+		 * parsing the configured one first */
+		g_setenv ("GTK_THEME", GREETER_THEME_NAME, TRUE);
+		settings = gtk_settings_get_for_screen (screen);
+		g_object_set (settings, "gtk-theme-name", GREETER_THEME_NAME, NULL);
+		g_unsetenv ("GTK_THEME");
+	} else {
+		GtkCssProvider *provider;
+
+		/* Also parses the configured theme, so it is timed below */
+		settings = gtk_settings_get_for_screen (screen);
+
+		provider = gtk_css_provider_new ();
+		gtk_css_provider_load_from_resource (provider, "/kr/gooroom/greeter/theme.css");
+		gtk_style_context_add_provider_for_screen (screen,
+                                                   GTK_STYLE_PROVIDER (provider),
+                                                   GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+		g_object_unref (provider);
+	}
+
+	if (start_time) {
+		gchar *what = g_strdup_printf ("Theme loaded (theme-mode=%s)", bundled ? "bundled" : "full");
+		greeter_profile_elapsed (what, start_time);
+		g_free (what);
+	}
+
+	g_free (mode);
+}
+
 //static gboolean
 //monitors_changed_idle_cb (gpointer user_data)
 //{
@@ -311,40 +342,55 @@ apply_gtk_config (void)
 //	g_timeout_add (300, (GSourceFunc)monitors_changed_idle_cb, user_data);
 //}
 
-static gboolean
-active_monitor_changed_idle_cb (gpointer user_data)
+static void
+monitor_topology_changed_cb (GreeterMonitorTopology *topology,
+                             const GreeterTopology  *snapshot,
+                             gpointer                user_data)
 {
-	GdkDisplay *display;
-	GdkRectangle geometry;
-	gint m, monitors = 0, real_monitor_num = 0;
-	cairo_region_t *region;
-
-	region = cairo_region_create ();
-	display = gdk_display_get_default ();
-	monitors = gdk_display_get_n_monitors (display);
-
-	for (m = 0; m < monitors; m++) {
-		GdkMonitor *monitor = gdk_display_get_monitor (display, m);
-		gdk_monitor_get_geometry (monitor, &geometry);
-
-		if (cairo_region_contains_rectangle (region, &geometry) == CAIRO_REGION_OVERLAP_IN)
-			continue;
-
-		cairo_region_union_rectangle (region, &geometry);
-		real_monitor_num++;
-	}
-
 	if (greeter_window)
 		greeter_window_set_switch_indicator_visible (GREETER_WINDOW (greeter_window),
-                                                     real_monitor_num > 1);
-
-	return FALSE;
+                                                     snapshot->n_distinct > 1);
 }
 
 static void
 active_monitor_changed_cb (GreeterBackground *background, gpointer user_data)
 {
-	g_timeout_add (300, (GSourceFunc) active_monitor_changed_idle_cb, NULL);
+	GdkRGBA color;
+	gboolean has_color;
+	const GdkRectangle *geometry;
+
+	geometry = greeter_background_get_active_monitor_geometry (background);
+	has_color = greeter_background_get_active_monitor_color (background, &color);
+	if (greeter_window && geometry)
+		greeter_window_set_active_monitor (GREETER_WINDOW (greeter_window), geometry,
+                                           greeter_background_get_active_monitor_scale (background),
+                                           greeter_background_pixbuf_get (background),
+                                           has_color ? &color : NULL);
+}
+
+static void
+login_form_after_paint_cb (GdkFrameClock *clock, gpointer user_data)
+{
+	g_signal_handlers_disconnect_by_func (clock, login_form_after_paint_cb, user_data);
+
+	greeter_profile_mark ("Login form ready");
+}
+
+/* The mark is taken when the frame that first drew the login form is done */
+static gboolean
+login_form_draw_cb (GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+	GdkFrameClock *clock;
+
+	g_signal_handlers_disconnect_by_func (widget, login_form_draw_cb, user_data);
+
+	clock = gtk_widget_get_frame_clock (widget);
+	if (clock)
+		g_signal_connect (clock, "after-paint", G_CALLBACK (login_form_after_paint_cb), NULL);
+	else
+		greeter_profile_mark ("Login form ready");
+
+	return FALSE;
 }
 
 static void
@@ -364,11 +410,12 @@ main (int argc, char **argv)
 	GdkScreen *screen = NULL;
 	gchar *background = NULL;
 //	gulong monitors_changed_id = 0;
-	GtkCssProvider *provider = NULL;
+	GdkCursor *cursor = NULL;
+	gint64 start_time = g_get_monotonic_time ();
+	gsize rss;
 
 	/* LP: #1024482 */
 	g_setenv ("GDK_CORE_DEVICE_EVENTS", "1", TRUE);
-	g_setenv ("GTK_MODULES", "atk-bridge", FALSE);
 
 	/* Make nm-applet hide items the user does not have permissions to interact with */
 	g_setenv ("NM_APPLET_HIDE_POLICY_ITEMS", "1", TRUE);
@@ -376,6 +423,7 @@ main (int argc, char **argv)
 	dbus_update_activation_environment ();
 
 	g_unix_signal_add (SIGTERM, (GSourceFunc)sigterm_cb, /* is_callback */ GINT_TO_POINTER (TRUE));
+	g_unix_signal_add (SIGUSR1, (GSourceFunc)sigusr1_cb, NULL);
 
 	/* Initialize i18n */
 	setlocale (LC_ALL, "");
@@ -383,12 +431,25 @@ main (int argc, char **argv)
 	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 	textdomain (GETTEXT_PACKAGE);
 
+	config_init ();
+	greeter_a11y_pre_init ();
+
+	rss = greeter_memory_enter ();
+
 	/* init gtk */
 	gtk_init (&argc, &argv);
 
-	config_init ();
 	apply_gtk_config ();
 
+	greeter_profile_init (start_time);
+	greeter_watchdog_start ();
+
+	screen = gdk_screen_get_default ();
+
+	load_theme (screen);
+
+	greeter_memory_leave ("toolkit", rss);
+
 	/* Starting window manager */
 	wm_start ();
 
@@ -398,35 +459,48 @@ main (int argc, char **argv)
 	notify_service_start ();
 	indicator_application_service_start ();
 
-	screen = gdk_screen_get_default ();
-
 	/* Set default cursor */
-	gdk_window_set_cursor (gdk_get_default_root_window (),
-                           gdk_cursor_new_for_display (gdk_display_get_default (),
-                           GDK_LEFT_PTR));
+	cursor = gdk_cursor_new_for_display (gdk_display_get_default (), GDK_LEFT_PTR);
+	gdk_window_set_cursor (gdk_get_default_root_window (), cursor);
+	g_object_unref (cursor);
 
+	rss = greeter_memory_enter ();
 	greeter_window = greeter_window_new ();
+	greeter_memory_leave ("login-window", rss);
 
+	rss = greeter_memory_enter ();
 	greeter_background = greeter_background_new (greeter_window);
 	background = config_get_string (CONFIG_GROUP_DEFAULT, CONFIG_KEY_BACKGROUND, NULL);
 	greeter_background_set_monitor_config (greeter_background, background);
 	greeter_background_connect (greeter_background, screen);
 	g_free (background);
+	greeter_memory_leave ("backgrounds", rss);
 
-	provider = gtk_css_provider_new ();
-	gtk_css_provider_load_from_resource (provider, "/kr/gooroom/greeter/theme.css");
-	gtk_style_context_add_provider_for_screen (screen,
-                                               GTK_STYLE_PROVIDER (provider),
-                                               GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-	g_clear_object (&provider);
+	greeter_spinner_init (screen);
 
 	gtk_widget_show (greeter_window);
 
+	greeter_a11y_init (greeter_background);
+
+	if (greeter_profile_enabled ())
+		g_signal_connect_after (greeter_window, "draw", G_CALLBACK (login_form_draw_cb), NULL);
+
+	greeter_profile_start_leak_check ();
+	greeter_memory_settle ();
+
+	/* Builds the splash window and the first pooled dialog */
+	rss = greeter_memory_enter ();
 	active_monitor_changed_cb (greeter_background, NULL);
+	greeter_memory_leave ("splash", rss);
 	g_signal_connect (G_OBJECT (greeter_background), "active-monitor-changed",
                       G_CALLBACK (active_monitor_changed_cb), NULL);
 
+	monitor_topology_changed_cb (NULL,
+                                 greeter_monitor_topology_get_snapshot (greeter_monitor_topology_get_default ()),
+                                 NULL);
+	g_signal_connect (G_OBJECT (greeter_monitor_topology_get_default ()), "changed",
+                      G_CALLBACK (monitor_topology_changed_cb), NULL);
+
 	g_signal_connect (greeter_window, "position-changed",
                       G_CALLBACK (greeter_window_active_monitor_changed_cb), NULL);
 
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+#include <atk-bridge.h>
+
+#include "greeter-a11y.h"
+#include "greeter-profile.h"
+#include "greeterconfiguration.h"
+
+
+static gboolean     a11y_enabled = FALSE;
+static GDBusProxy  *a11y_status_proxy = NULL;
+
+
+/* Called before gtk_init(): unless accessibility is configured on, GTK
+ * must not bring up the AT-SPI bridge by itself. */
+void
+greeter_a11y_pre_init (void)
+{
+	a11y_enabled = config_get_bool (CONFIG_GROUP_DEFAULT, CONFIG_KEY_ACCESSIBILITY, FALSE);
+
+	if (!a11y_enabled)
+		g_setenv ("NO_AT_BRIDGE", "1", TRUE);
+}
+
+void
+greeter_a11y_enable (void)
+{
+	gint64 start_time;
+	gsize start_rss;
+
+	if (a11y_enabled)
+		return;
+
+	a11y_enabled = TRUE;
+	g_clear_object (&a11y_status_proxy);
+
+	start_time = g_get_monotonic_time ();
+	start_rss = greeter_profile_get_rss ();
+
+	if (atk_bridge_adaptor_init (NULL, NULL) != 0) {
+		g_warning ("[A11y] Failed to initialize the AT-SPI bridge");
+		return;
+	}
+
+	/* This is what every greeter start used to pay */
+	g_debug ("[A11y] AT-SPI bridge enabled in %.1f ms, RSS +%" G_GSSIZE_FORMAT " KiB",
+             (g_get_monotonic_time () - start_time) / 1000.0,
+             (gssize) (greeter_profile_get_rss () - start_rss) / 1024);
+}
+
+static void
+a11y_check_screen_reader (GDBusProxy *proxy)
+{
+	GVariant *value;
+
+	value = g_dbus_proxy_get_cached_property (proxy, "ScreenReaderEnabled");
+	if (!value)
+		return;
+
+	if (g_variant_get_boolean (value))
+		greeter_a11y_enable ();
+
+	g_variant_unref (value);
+}
+
+static void
+a11y_status_changed_cb (GDBusProxy *proxy,
+                        GVariant   *changed_properties,
+                        GStrv       invalidated_properties,
+                        gpointer    user_data)
+{
+	a11y_check_screen_reader (proxy);
+}
+
+static void
+a11y_status_proxy_ready_cb (GObject      *source,
+                            GAsyncResult *res,
+                            gpointer      user_data)
+{
+	GDBusProxy *proxy;
+	GError *error = NULL;
+
+	proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (!proxy) {
+		g_debug ("[A11y] Accessibility bus status is not available: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	if (a11y_enabled) {
+		g_object_unref (proxy);
+		return;
+	}
+
+	a11y_status_proxy = proxy;
+	g_signal_connect (a11y_status_proxy, "g-properties-changed",
+                      G_CALLBACK (a11y_status_changed_cb), NULL);
+
+	a11y_check_screen_reader (a11y_status_proxy);
+}
+
+static gboolean
+a11y_hotkey_cb (GtkAccelGroup   *group,
+                GObject         *acceleratable,
+                guint            keyval,
+                GdkModifierType  modifier,
+                gpointer         user_data)
+{
+	greeter_a11y_enable ();
+
+	return TRUE;
+}
+
+/* The bridge is brought up on demand: when a screen reader is turned on
+ * on the accessibility bus, or with Super+Alt+S like in GNOME. */
+void
+greeter_a11y_init (GreeterBackground *background)
+{
+	GClosure *closure;
+	GtkAccelGroup *group;
+
+	/* Children started by the greeter decide for themselves */
+	g_unsetenv ("NO_AT_BRIDGE");
+
+	if (a11y_enabled)
+		return;
+
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SESSION,
+                              G_DBUS_PROXY_FLAGS_NONE,
+                              NULL,
+                              "org.a11y.Bus",
+                              "/org/a11y/bus",
+                              "org.a11y.Status",
+                              NULL,
+                              a11y_status_proxy_ready_cb,
+                              NULL);
+
+	group = gtk_accel_group_new ();
+	closure = g_cclosure_new (G_CALLBACK (a11y_hotkey_cb), NULL, NULL);
+	gtk_accel_group_connect (group, GDK_KEY_s, GDK_SUPER_MASK | GDK_MOD1_MASK, 0, closure);
+
+	greeter_background_add_accel_group (background, group);
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef __GREETER_A11Y_H__
+#define __GREETER_A11Y_H__
+
+#include <glib.h>
+
+#include "greeterbackground.h"
+
+G_BEGIN_DECLS
+
+void  greeter_a11y_pre_init (void);
+void  greeter_a11y_init     (GreeterBackground *background);
+void  greeter_a11y_enable   (void);
+
+G_END_DECLS
+
+#endif /* __GREETER_A11Y_H__ */
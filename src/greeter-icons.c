@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "greeter-icons.h"
+
+#define ICONS_RESOURCE_PATH  "/kr/gooroom/greeter/icons"
+
+
+/* Icons embedded at build time (see extract-icons.sh) are returned as
+ * resource files, which GtkIconTheme loads without reading the theme index
+ * or scanning its directories. Symbolic icons keep their "-symbolic.svg"
+ * name, so they are still recolored. Anything else is a themed icon. */
+GIcon *
+greeter_icon_new (const gchar *icon_name)
+{
+	GIcon *icon = NULL;
+	gchar *name, *path;
+
+	g_return_val_if_fail (icon_name != NULL, NULL);
+
+	name = g_strdup (icon_name);
+	if (g_str_has_suffix (name, ".symbolic"))
+		name[strlen (name) - strlen (".symbolic")] = '\0';
+
+	path = g_strdup_printf (ICONS_RESOURCE_PATH "/%s.svg", name);
+
+	if (g_resources_get_info (path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL, NULL, NULL)) {
+		GFile *file;
+		gchar *uri;
+
+		uri = g_strconcat ("resource://", path, NULL);
+		file = g_file_new_for_uri (uri);
+		icon = g_file_icon_new (file);
+		g_object_unref (file);
+		g_free (uri);
+	}
+
+	g_free (path);
+	g_free (name);
+
+	return icon ? icon : g_themed_icon_new (icon_name);
+}
+
+void
+greeter_image_set_icon_name (GtkImage    *image,
+                             const gchar *icon_name,
+                             GtkIconSize  size)
+{
+	GIcon *icon;
+
+	g_return_if_fail (GTK_IS_IMAGE (image));
+
+	icon = greeter_icon_new (icon_name);
+	gtk_image_set_from_gicon (image, icon, size);
+	g_object_unref (icon);
+}
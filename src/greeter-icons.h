@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef __GREETER_ICONS_H__
+#define __GREETER_ICONS_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+GIcon *greeter_icon_new            (const gchar *icon_name);
+void   greeter_image_set_icon_name (GtkImage    *image,
+                                    const gchar *icon_name,
+                                    GtkIconSize  size);
+
+G_END_DECLS
+
+#endif /* __GREETER_ICONS_H__ */
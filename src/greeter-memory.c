@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#if defined(HAVE_MALLOC_TRIM) || defined(HAVE_MALLINFO2)
+#include <malloc.h>
+#endif
+
+#include "greeter-memory.h"
+#include "greeter-profile.h"
+#include "greeterconfiguration.h"
+
+
+/* Seconds after the login form is shown until startup is considered settled */
+#define SETTLE_DELAY  5
+
+#define MIB(bytes) ((gdouble) (bytes) / (1024 * 1024))
+
+typedef struct
+{
+	const gchar *name;
+	gssize       bytes;
+} Subsystem;
+
+static gint     low_memory = -1;
+static GArray  *subsystems = NULL;
+
+
+gboolean
+greeter_memory_is_low (void)
+{
+	if (low_memory < 0)
+		low_memory = config_get_bool (NULL, CONFIG_KEY_LOW_MEMORY, FALSE);
+
+	return low_memory;
+}
+
+/* Returns the RSS to pass to greeter_memory_leave() */
+gsize
+greeter_memory_enter (void)
+{
+	return greeter_profile_get_rss ();
+}
+
+/* Charges the RSS growth since greeter_memory_enter() to @subsystem, which
+ * must be a static string */
+void
+greeter_memory_leave (const gchar *subsystem, gsize since)
+{
+	guint i;
+	Subsystem *entry;
+	gsize rss;
+
+	if (since == 0)
+		return;
+
+	rss = greeter_profile_get_rss ();
+
+	if (!subsystems)
+		subsystems = g_array_new (FALSE, FALSE, sizeof (Subsystem));
+
+	for (i = 0; i < subsystems->len; i++) {
+		entry = &g_array_index (subsystems, Subsystem, i);
+		if (g_strcmp0 (entry->name, subsystem) == 0) {
+			entry->bytes += (gssize) rss - (gssize) since;
+			return;
+		}
+	}
+
+	g_array_set_size (subsystems, subsystems->len + 1);
+	entry = &g_array_index (subsystems, Subsystem, subsystems->len - 1);
+	entry->name = subsystem;
+	entry->bytes = (gssize) rss - (gssize) since;
+}
+
+/* RSS broken down by the subsystems charged with greeter_memory_leave();
+ * what was not charged to any is listed as "other". Warns when over the
+ * configured memory-budget, so that it can be checked from the log. */
+void
+greeter_memory_report (void)
+{
+	guint i;
+	gsize rss;
+	gssize other;
+	gint budget;
+
+	rss = greeter_profile_get_rss ();
+	if (rss == 0)
+		return;
+
+	budget = config_get_int (NULL, CONFIG_KEY_MEMORY_BUDGET, 0);
+
+	g_message ("[Memory] RSS %.1f MiB%s", MIB (rss),
+               greeter_memory_is_low () ? " (low-memory)" : "");
+
+	other = rss;
+	for (i = 0; subsystems && i < subsystems->len; i++) {
+		Subsystem *entry = &g_array_index (subsystems, Subsystem, i);
+
+		g_message ("[Memory]   %-12s %6.1f MiB", entry->name, MIB (entry->bytes));
+		other -= entry->bytes;
+	}
+	g_message ("[Memory]   %-12s %6.1f MiB", "other", MIB (other));
+
+#ifdef HAVE_MALLINFO2
+	{
+		struct mallinfo2 info = mallinfo2 ();
+		g_message ("[Memory]   malloc heap: %.1f MiB in use, %.1f MiB free",
+                   MIB (info.uordblks), MIB (info.fordblks));
+	}
+#endif
+
+	if (budget > 0 && rss > (gsize) budget * 1024 * 1024)
+		g_warning ("[Memory] RSS %.1f MiB is over the budget of %d MiB", MIB (rss), budget);
+}
+
+static gboolean
+settle_timeout_cb (gpointer user_data)
+{
+	if (greeter_memory_is_low ()) {
+#ifdef HAVE_MALLOC_TRIM
+		gsize before = greeter_profile_get_rss ();
+
+		/* Startup leaves most of its temporary allocations in free lists */
+		malloc_trim (0);
+
+		g_debug ("[Memory] malloc_trim released %.1f MiB",
+                 MIB ((gssize) before - (gssize) greeter_profile_get_rss ()));
+#endif
+	}
+
+	if (greeter_memory_is_low () || greeter_profile_enabled ())
+		greeter_memory_report ();
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Called once the login form is up */
+void
+greeter_memory_settle (void)
+{
+	g_timeout_add_seconds (SETTLE_DELAY, settle_timeout_cb, NULL);
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef __GREETER_MEMORY_H__
+#define __GREETER_MEMORY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean  greeter_memory_is_low (void);
+
+gsize     greeter_memory_enter  (void);
+void      greeter_memory_leave  (const gchar *subsystem,
+                                 gsize        since);
+
+void      greeter_memory_settle (void);
+void      greeter_memory_report (void);
+
+G_END_DECLS
+
+#endif /* __GREETER_MEMORY_H__ */
@@ -17,12 +17,15 @@
 #include <gtk/gtk.h>
 
 #include "greeter-message-dialog.h"
+#include "greeter-profile.h"
+#include "greeter-icons.h"
 
 struct _GreeterMessageDialogPrivate {
 	GtkWidget *icon_image;
 	GtkWidget *title_box;
 	GtkWidget *title_label;
 	GtkWidget *message_label;
+	GtkWidget *action_area;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GreeterMessageDialog, greeter_message_dialog, GTK_TYPE_DIALOG);
@@ -60,6 +63,8 @@ greeter_message_dialog_init (GreeterMessageDialog *dialog)
 		gtk_widget_set_visual (GTK_WIDGET (dialog), visual);
 	}
 
+	greeter_profile_track_frames (GTK_WIDGET (dialog), "dialog");
+
 //	PangoAttrList *attrs;
 //	PangoAttribute *attr;
 //	attrs = pango_attr_list_new ();
@@ -85,6 +90,7 @@ greeter_message_dialog_class_init (GreeterMessageDialogClass *klass)
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GreeterMessageDialog, title_box);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GreeterMessageDialog, title_label);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GreeterMessageDialog, message_label);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GreeterMessageDialog, action_area);
 }
 
 GtkWidget *
@@ -132,9 +138,29 @@ greeter_message_dialog_set_icon (GreeterMessageDialog *dialog,
                                  const char           *icon)
 {
 	if (icon) {
-		gtk_image_set_from_icon_name (GTK_IMAGE (dialog->priv->icon_image),
-                                      icon, GTK_ICON_SIZE_DIALOG);
+		greeter_image_set_icon_name (GTK_IMAGE (dialog->priv->icon_image),
+                                     icon, GTK_ICON_SIZE_DIALOG);
 
 		gtk_widget_show (dialog->priv->icon_image);
 	}
 }
+
+/* Drops the buttons, icon and title so a hidden dialog can be shown again
+ * with other contents, without building a new one from the template */
+void
+greeter_message_dialog_reset (GreeterMessageDialog *dialog)
+{
+	GList *children, *l;
+
+	g_return_if_fail (GREETER_IS_MESSAGE_DIALOG (dialog));
+
+	children = gtk_container_get_children (GTK_CONTAINER (dialog->priv->action_area));
+	for (l = children; l; l = l->next)
+		gtk_widget_destroy (GTK_WIDGET (l->data));
+	g_list_free (children);
+
+	gtk_widget_hide (dialog->priv->icon_image);
+	greeter_message_dialog_set_title (dialog, NULL);
+	gtk_label_set_text (GTK_LABEL (dialog->priv->title_label), "");
+	gtk_label_set_text (GTK_LABEL (dialog->priv->message_label), "");
+}
@@ -50,6 +50,7 @@ void greeter_message_dialog_set_message     (GreeterMessageDialog *dialog,
                                              const char           *message);
 void greeter_message_dialog_set_icon        (GreeterMessageDialog *dialog,
                                              const char           *icon);
+void greeter_message_dialog_reset           (GreeterMessageDialog *dialog);
 
 G_END_DECLS
 
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "greeter-monitor-topology.h"
+
+
+enum
+{
+	CHANGED,
+	LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = {0};
+
+struct _GreeterMonitorTopologyPrivate
+{
+	GdkScreen       *screen;
+	gulong           monitors_changed_id;
+
+	GreeterTopology *snapshot;
+	guint            serial;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (GreeterMonitorTopology, greeter_monitor_topology, G_TYPE_OBJECT);
+
+
+GreeterTopology *
+greeter_topology_ref (GreeterTopology *snapshot)
+{
+	g_return_val_if_fail (snapshot != NULL, NULL);
+
+	g_atomic_int_inc (&snapshot->ref_count);
+
+	return snapshot;
+}
+
+void
+greeter_topology_unref (GreeterTopology *snapshot)
+{
+	gint i;
+
+	g_return_if_fail (snapshot != NULL);
+
+	if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+		return;
+
+	for (i = 0; i < snapshot->n_outputs; i++)
+		g_free (snapshot->outputs[i].model);
+
+	g_free (snapshot->outputs);
+	g_free (snapshot);
+}
+
+const GreeterOutput *
+greeter_topology_get_output (const GreeterTopology *snapshot, gint number)
+{
+	g_return_val_if_fail (snapshot != NULL, NULL);
+
+	if (number < 0 || number >= snapshot->n_outputs)
+		return NULL;
+
+	return &snapshot->outputs[number];
+}
+
+/* The distinct output covering exactly @geometry */
+const GreeterOutput *
+greeter_topology_find_output (const GreeterTopology *snapshot, const GdkRectangle *geometry)
+{
+	gint i;
+
+	g_return_val_if_fail (snapshot != NULL, NULL);
+	g_return_val_if_fail (geometry != NULL, NULL);
+
+	for (i = 0; i < snapshot->n_outputs; i++) {
+		const GreeterOutput *output = &snapshot->outputs[i];
+		if (output->mirror_of < 0 && gdk_rectangle_equal (&output->geometry, geometry))
+			return output;
+	}
+
+	return NULL;
+}
+
+static void monitors_changed_cb (GdkScreen *screen, gpointer user_data);
+
+static void
+scale_factor_changed_cb (GObject    *object,
+                         GParamSpec *pspec,
+                         gpointer    user_data)
+{
+	/* Scaled wallpapers depend on it, handle it like a layout change */
+	monitors_changed_cb (NULL, user_data);
+}
+
+static GreeterTopology *
+topology_snapshot_new (GreeterMonitorTopology *topology)
+{
+	gint i, j;
+	GdkDisplay *display;
+	cairo_region_t *region;
+	GreeterTopology *snapshot;
+	GreeterMonitorTopologyPrivate *priv = topology->priv;
+
+	display = gdk_screen_get_display (priv->screen);
+
+	snapshot = g_new0 (GreeterTopology, 1);
+	snapshot->ref_count = 1;
+	snapshot->serial = ++priv->serial;
+	snapshot->n_outputs = gdk_display_get_n_monitors (display);
+	snapshot->outputs = g_new0 (GreeterOutput, snapshot->n_outputs);
+	snapshot->primary = 0;
+	snapshot->active = -1;
+
+	region = cairo_region_create ();
+
+	for (i = 0; i < snapshot->n_outputs; i++) {
+		GreeterOutput *output = &snapshot->outputs[i];
+		GdkMonitor *monitor = gdk_display_get_monitor (display, i);
+
+		output->number = i;
+		output->model = g_strdup (gdk_monitor_get_model (monitor));
+		output->scale_factor = gdk_monitor_get_scale_factor (monitor);
+		output->primary = gdk_monitor_is_primary (monitor);
+		output->mirror_of = -1;
+		gdk_monitor_get_geometry (monitor, &output->geometry);
+
+		g_signal_handlers_disconnect_by_func (monitor, scale_factor_changed_cb, topology);
+		g_signal_connect_object (monitor, "notify::scale-factor",
+                                 G_CALLBACK (scale_factor_changed_cb), topology, 0);
+
+		if (output->primary)
+			snapshot->primary = i;
+
+		/* Simple check to skip fully overlapped monitors.
+		   Actually, it's can track only monitors in "mirrors" mode. Nothing more. */
+		if (cairo_region_contains_rectangle (region, &output->geometry) == CAIRO_REGION_OVERLAP_IN) {
+			output->mirror_of = 0;
+			for (j = 0; j < i; j++) {
+				const GreeterOutput *other = &snapshot->outputs[j];
+				if (other->mirror_of < 0 &&
+                    gdk_rectangle_intersect (&other->geometry, &output->geometry, NULL)) {
+					output->mirror_of = j;
+					break;
+				}
+			}
+			continue;
+		}
+
+		cairo_region_union_rectangle (region, &output->geometry);
+		snapshot->n_distinct++;
+	}
+
+	cairo_region_destroy (region);
+
+	/* A mirrored primary is represented by the output it repeats */
+	if (snapshot->n_outputs > 0 && snapshot->outputs[snapshot->primary].mirror_of >= 0)
+		snapshot->primary = snapshot->outputs[snapshot->primary].mirror_of;
+
+	return snapshot;
+}
+
+static void
+topology_publish (GreeterMonitorTopology *topology, GreeterTopology *snapshot)
+{
+	GreeterMonitorTopologyPrivate *priv = topology->priv;
+
+	if (priv->snapshot)
+		greeter_topology_unref (priv->snapshot);
+	priv->snapshot = snapshot;
+
+	/* A handler may publish again (the background sets the active output
+	 * while reconnecting), so keep this snapshot alive for the rest of
+	 * the emission */
+	greeter_topology_ref (snapshot);
+	g_signal_emit (topology, signals[CHANGED], 0, snapshot);
+	greeter_topology_unref (snapshot);
+}
+
+static void
+monitors_changed_cb (GdkScreen *screen, gpointer user_data)
+{
+	GreeterMonitorTopology *topology = GREETER_MONITOR_TOPOLOGY (user_data);
+	GreeterTopology *snapshot;
+	gint active = -1;
+
+	snapshot = topology_snapshot_new (topology);
+
+	/* Keep the active output if it is still a distinct output */
+	if (topology->priv->snapshot && topology->priv->snapshot->active >= 0) {
+		const GreeterOutput *old, *output;
+		old = &topology->priv->snapshot->outputs[topology->priv->snapshot->active];
+		output = greeter_topology_find_output (snapshot, &old->geometry);
+		if (output)
+			active = output->number;
+	}
+	snapshot->active = active;
+
+	g_debug ("[Topology] %d outputs, %d distinct, primary #%d",
+             snapshot->n_outputs, snapshot->n_distinct, snapshot->primary);
+
+	topology_publish (topology, snapshot);
+}
+
+static void
+greeter_monitor_topology_finalize (GObject *object)
+{
+	GreeterMonitorTopology *topology = GREETER_MONITOR_TOPOLOGY (object);
+	GreeterMonitorTopologyPrivate *priv = topology->priv;
+
+	if (priv->monitors_changed_id)
+		g_signal_handler_disconnect (priv->screen, priv->monitors_changed_id);
+
+	g_clear_pointer (&priv->snapshot, greeter_topology_unref);
+
+	G_OBJECT_CLASS (greeter_monitor_topology_parent_class)->finalize (object);
+}
+
+static void
+greeter_monitor_topology_init (GreeterMonitorTopology *topology)
+{
+	GreeterMonitorTopologyPrivate *priv;
+	priv = topology->priv = greeter_monitor_topology_get_instance_private (topology);
+
+	priv->serial = 0;
+	priv->screen = gdk_screen_get_default ();
+	priv->snapshot = topology_snapshot_new (topology);
+	priv->monitors_changed_id = g_signal_connect (G_OBJECT (priv->screen), "monitors-changed",
+                                                  G_CALLBACK (monitors_changed_cb), topology);
+}
+
+static void
+greeter_monitor_topology_class_init (GreeterMonitorTopologyClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = greeter_monitor_topology_finalize;
+
+	signals[CHANGED] =
+		g_signal_new ("changed",
+                      G_TYPE_FROM_CLASS (object_class),
+                      G_SIGNAL_RUN_FIRST,
+                      G_STRUCT_OFFSET (GreeterMonitorTopologyClass, changed),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__POINTER,
+                      G_TYPE_NONE, 1,
+                      G_TYPE_POINTER);
+}
+
+/* The topology is computed once per monitors-changed and shared by the
+ * background, the splash window and the monitor switcher. */
+GreeterMonitorTopology *
+greeter_monitor_topology_get_default (void)
+{
+	static GreeterMonitorTopology *topology = NULL;
+
+	if (!topology)
+		topology = g_object_new (GREETER_TYPE_MONITOR_TOPOLOGY, NULL);
+
+	return topology;
+}
+
+/* Valid until the next "changed" emission, use greeter_topology_ref() to keep it */
+const GreeterTopology *
+greeter_monitor_topology_get_snapshot (GreeterMonitorTopology *topology)
+{
+	g_return_val_if_fail (GREETER_IS_MONITOR_TOPOLOGY (topology), NULL);
+
+	return topology->priv->snapshot;
+}
+
+void
+greeter_monitor_topology_set_active (GreeterMonitorTopology *topology, gint number)
+{
+	GreeterTopology *snapshot;
+	const GreeterTopology *current;
+	gint i;
+
+	g_return_if_fail (GREETER_IS_MONITOR_TOPOLOGY (topology));
+
+	current = topology->priv->snapshot;
+	if (current->active == number)
+		return;
+
+	/* Snapshots are immutable, publish a copy with the new active output */
+	snapshot = g_new0 (GreeterTopology, 1);
+	*snapshot = *current;
+	snapshot->ref_count = 1;
+	snapshot->active = number;
+	snapshot->outputs = g_new0 (GreeterOutput, current->n_outputs);
+	for (i = 0; i < current->n_outputs; i++) {
+		snapshot->outputs[i] = current->outputs[i];
+		snapshot->outputs[i].model = g_strdup (current->outputs[i].model);
+	}
+
+	topology_publish (topology, snapshot);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef __GREETER_MONITOR_TOPOLOGY_H__
+#define __GREETER_MONITOR_TOPOLOGY_H__
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define GREETER_TYPE_MONITOR_TOPOLOGY            (greeter_monitor_topology_get_type ())
+#define GREETER_MONITOR_TOPOLOGY(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GREETER_TYPE_MONITOR_TOPOLOGY, GreeterMonitorTopology))
+#define GREETER_MONITOR_TOPOLOGY_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GREETER_TYPE_MONITOR_TOPOLOGY, GreeterMonitorTopologyClass))
+#define GREETER_IS_MONITOR_TOPOLOGY(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GREETER_TYPE_MONITOR_TOPOLOGY))
+#define GREETER_IS_MONITOR_TOPOLOGY_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GREETER_TYPE_MONITOR_TOPOLOGY))
+
+typedef struct _GreeterMonitorTopology        GreeterMonitorTopology;
+typedef struct _GreeterMonitorTopologyClass   GreeterMonitorTopologyClass;
+typedef struct _GreeterMonitorTopologyPrivate GreeterMonitorTopologyPrivate;
+
+/* One GDK monitor */
+typedef struct
+{
+	gint          number;
+	gchar        *model;
+	GdkRectangle  geometry;
+	gint          scale_factor;
+	gboolean      primary;
+	/* Number of the distinct output whose area this one repeats, or -1 */
+	gint          mirror_of;
+} GreeterOutput;
+
+/* Immutable snapshot of the monitor layout */
+typedef struct
+{
+	gint           ref_count;
+	/* Bumped on every layout change, but not when only the active output changes */
+	guint          serial;
+	GreeterOutput *outputs;
+	gint           n_outputs;
+	gint           n_distinct;
+	gint           primary;
+	/* Output showing the login panel, or -1 */
+	gint           active;
+} GreeterTopology;
+
+struct _GreeterMonitorTopology {
+	GObject __parent__;
+
+	GreeterMonitorTopologyPrivate *priv;
+};
+
+struct _GreeterMonitorTopologyClass {
+	GObjectClass __parent_class__;
+
+	void (*changed) (GreeterMonitorTopology *topology, const GreeterTopology *snapshot);
+};
+
+GType                   greeter_monitor_topology_get_type     (void) G_GNUC_CONST;
+
+GreeterMonitorTopology *greeter_monitor_topology_get_default  (void);
+
+const GreeterTopology  *greeter_monitor_topology_get_snapshot (GreeterMonitorTopology *topology);
+void                    greeter_monitor_topology_set_active   (GreeterMonitorTopology *topology,
+                                                               gint                    number);
+
+GreeterTopology        *greeter_topology_ref                  (GreeterTopology        *snapshot);
+void                    greeter_topology_unref                (GreeterTopology        *snapshot);
+
+const GreeterOutput    *greeter_topology_get_output           (const GreeterTopology  *snapshot,
+                                                               gint                    number);
+const GreeterOutput    *greeter_topology_find_output          (const GreeterTopology  *snapshot,
+                                                               const GdkRectangle     *geometry);
+
+G_END_DECLS
+
+#endif /* __GREETER_MONITOR_TOPOLOGY_H__ */
@@ -17,6 +17,7 @@
 #include <gtk/gtk.h>
 
 #include "greeter-password-settings-dialog.h"
+#include "greeter-profile.h"
 
 
 
@@ -111,6 +112,8 @@ greeter_password_settings_dialog_init (GreeterPasswordSettingsDialog *dialog)
 		gtk_widget_set_visual (GTK_WIDGET (dialog), visual);
 	}
 
+	greeter_profile_track_frames (GTK_WIDGET (dialog), "dialog");
+
 	g_signal_connect (G_OBJECT (priv->prompt_entry), "activate",
                       G_CALLBACK (prompt_entry_activate_cb), dialog);
     g_signal_connect (G_OBJECT (priv->prompt_entry), "changed",
@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "greeter-profile.h"
+#include "greeterconfiguration.h"
+
+
+/* Growth over the first sample that is reported as a probable leak */
+#define LEAK_CHECK_RSS_GROWTH     (16 * 1024 * 1024)
+#define LEAK_CHECK_OBJECT_GROWTH  200
+
+static gboolean profile_enabled = FALSE;
+static gint64   profile_start_time = 0;
+
+static gsize       leak_check_base_rss = 0;
+static GHashTable *leak_check_base_counts = NULL;
+
+/* Warned about once per threshold crossing, until back under it */
+static gboolean    leak_check_rss_warned = FALSE;
+static GHashTable *leak_check_warned_types = NULL;
+
+/* Upper bounds of the frame time histogram buckets, in milliseconds */
+static const gint frame_buckets[] = { 4, 8, 16, 33, 50, 100, G_MAXINT };
+#define N_FRAME_BUCKETS G_N_ELEMENTS (frame_buckets)
+
+typedef struct
+{
+	guint frames;
+	guint layout[N_FRAME_BUCKETS];
+	guint paint[N_FRAME_BUCKETS];
+	guint total[N_FRAME_BUCKETS];
+} FrameStats;
+
+/* One per frame clock */
+typedef struct
+{
+	FrameStats *stats;
+	gint64      begin;
+	gint64      layout_done;
+	gint64      paint_done;
+} FrameState;
+
+static gboolean    frame_timing_enabled = FALSE;
+
+/* Window name => <FrameStats*> */
+static GHashTable *frame_stats = NULL;
+
+
+/* @start_time is the monotonic time at which the greeter process started;
+ * marks are reported relative to it. */
+void
+greeter_profile_init (gint64 start_time)
+{
+	profile_start_time = start_time;
+	profile_enabled = config_get_bool (NULL, CONFIG_KEY_PROFILING, FALSE);
+	frame_timing_enabled = config_get_bool (NULL, CONFIG_KEY_FRAME_TIMING, FALSE);
+}
+
+gboolean
+greeter_profile_enabled (void)
+{
+	return profile_enabled;
+}
+
+void
+greeter_profile_mark (const gchar *what)
+{
+	if (!profile_enabled)
+		return;
+
+	g_message ("[Profile] %s: %.1f ms since start", what,
+               (g_get_monotonic_time () - profile_start_time) / 1000.0);
+}
+
+void
+greeter_profile_elapsed (const gchar *what, gint64 since)
+{
+	if (!profile_enabled || since == 0)
+		return;
+
+	g_message ("[Profile] %s: %.1f ms", what,
+               (g_get_monotonic_time () - since) / 1000.0);
+}
+
+/* Resident set size of the greeter process in bytes, 0 if unknown */
+gsize
+greeter_profile_get_rss (void)
+{
+	gchar *contents = NULL;
+	gulong size = 0, resident = 0;
+
+	if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+		return 0;
+
+	if (sscanf (contents, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+
+	g_free (contents);
+
+	return (gsize) resident * sysconf (_SC_PAGESIZE);
+}
+
+static void
+count_instances (GType type, GHashTable *counts)
+{
+	GType *children;
+	guint i, n_children;
+	gint count;
+
+	count = g_type_get_instance_count (type);
+	if (count > 0)
+		g_hash_table_insert (counts, GSIZE_TO_POINTER (type), GINT_TO_POINTER (count));
+
+	children = g_type_children (type, &n_children);
+	for (i = 0; i < n_children; i++)
+		count_instances (children[i], counts);
+	g_free (children);
+}
+
+static gboolean
+leak_check_cb (gpointer user_data)
+{
+	gsize rss;
+	gpointer key, value;
+	GHashTableIter iter;
+	GHashTable *counts;
+
+	rss = greeter_profile_get_rss ();
+	counts = g_hash_table_new (g_direct_hash, g_direct_equal);
+	count_instances (G_TYPE_OBJECT, counts);
+
+	/* The first sample, taken once startup has settled, is the baseline */
+	if (!leak_check_base_counts) {
+		leak_check_base_rss = rss;
+		leak_check_base_counts = counts;
+		leak_check_warned_types = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_debug ("[Profile] Leak check baseline: RSS %" G_GSIZE_FORMAT " KiB, %u object types",
+                 rss / 1024, g_hash_table_size (counts));
+		return G_SOURCE_CONTINUE;
+	}
+
+	g_hash_table_iter_init (&iter, counts);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		gint base = GPOINTER_TO_INT (g_hash_table_lookup (leak_check_base_counts, key));
+		gint count = GPOINTER_TO_INT (value);
+
+		if (count - base <= LEAK_CHECK_OBJECT_GROWTH)
+			g_hash_table_remove (leak_check_warned_types, key);
+		else if (g_hash_table_add (leak_check_warned_types, key))
+			g_warning ("[Profile] %s instances grew from %d to %d",
+                       g_type_name (GPOINTER_TO_SIZE (key)), base, count);
+	}
+
+	/* Types whose instances are all gone are back under the threshold too */
+	g_hash_table_iter_init (&iter, leak_check_warned_types);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_contains (counts, key))
+			g_hash_table_iter_remove (&iter);
+	}
+
+	if (rss > leak_check_base_rss + LEAK_CHECK_RSS_GROWTH) {
+		if (!leak_check_rss_warned)
+			g_warning ("[Profile] RSS grew from %" G_GSIZE_FORMAT " KiB to %" G_GSIZE_FORMAT " KiB",
+                       leak_check_base_rss / 1024, rss / 1024);
+		leak_check_rss_warned = TRUE;
+	} else {
+		leak_check_rss_warned = FALSE;
+		g_debug ("[Profile] RSS %" G_GSIZE_FORMAT " KiB", rss / 1024);
+	}
+
+	g_hash_table_destroy (counts);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* GLib only counts instances with GOBJECT_DEBUG=instance-count (or "all"),
+ * g_type_get_instance_count () returns 0 otherwise */
+static gboolean
+instance_count_enabled (void)
+{
+	static const GDebugKey keys[] = { { "instance-count", 1 } };
+
+	return g_parse_debug_string (g_getenv ("GOBJECT_DEBUG"), keys, G_N_ELEMENTS (keys)) != 0;
+}
+
+/* Periodically compares RSS and live GObject counts against the first
+ * sample. Meant for greeters left on the login screen for days. */
+void
+greeter_profile_start_leak_check (void)
+{
+	gint interval;
+
+	interval = config_get_int (NULL, CONFIG_KEY_LEAK_CHECK_INTERVAL, 0);
+	if (interval <= 0)
+		return;
+
+	if (!instance_count_enabled ())
+		g_warning ("[Profile] GOBJECT_DEBUG=instance-count is not set, only RSS is checked for leaks");
+
+	g_timeout_add_seconds (interval, leak_check_cb, NULL);
+}
+
+static gint
+compare_counts (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	GHashTable *counts = user_data;
+
+	return GPOINTER_TO_INT (g_hash_table_lookup (counts, b)) -
+           GPOINTER_TO_INT (g_hash_table_lookup (counts, a));
+}
+
+/* Logs the live instances of every GObject type, most numerous first */
+void
+greeter_profile_report_objects (void)
+{
+	GList *types, *l;
+	GHashTable *counts;
+
+	if (!instance_count_enabled ())
+		return;
+
+	counts = g_hash_table_new (g_direct_hash, g_direct_equal);
+	count_instances (G_TYPE_OBJECT, counts);
+
+	types = g_list_sort_with_data (g_hash_table_get_keys (counts), compare_counts, counts);
+	for (l = types; l; l = l->next)
+		g_message ("[Objects] %s %d", g_type_name (GPOINTER_TO_SIZE (l->data)),
+                   GPOINTER_TO_INT (g_hash_table_lookup (counts, l->data)));
+
+	g_list_free (types);
+	g_hash_table_destroy (counts);
+}
+
+static void
+frame_stats_add (guint *histogram, gint64 usec)
+{
+	guint i;
+
+	for (i = 0; i < N_FRAME_BUCKETS; i++) {
+		if (usec < frame_buckets[i] * 1000) {
+			histogram[i]++;
+			return;
+		}
+	}
+}
+
+/* The layout and paint handlers are connected after the ones of GTK and
+ * GDK, so they run when that phase of the frame is done. */
+static void
+frame_before_paint_cb (GdkFrameClock *clock, FrameState *state)
+{
+	state->begin = g_get_monotonic_time ();
+	state->layout_done = state->paint_done = 0;
+}
+
+static void
+frame_layout_cb (GdkFrameClock *clock, FrameState *state)
+{
+	state->layout_done = g_get_monotonic_time ();
+}
+
+static void
+frame_paint_cb (GdkFrameClock *clock, FrameState *state)
+{
+	state->paint_done = g_get_monotonic_time ();
+}
+
+static void
+frame_after_paint_cb (GdkFrameClock *clock, FrameState *state)
+{
+	gint64 now = g_get_monotonic_time ();
+
+	if (state->begin == 0)
+		return;
+
+	if (state->layout_done == 0)
+		state->layout_done = state->begin;
+	if (state->paint_done == 0)
+		state->paint_done = state->layout_done;
+
+	state->stats->frames++;
+	frame_stats_add (state->stats->layout, state->layout_done - state->begin);
+	frame_stats_add (state->stats->paint, state->paint_done - state->layout_done);
+	frame_stats_add (state->stats->total, now - state->begin);
+
+	state->begin = 0;
+}
+
+static void
+frame_track_realize_cb (GtkWidget *widget, gpointer user_data)
+{
+	FrameState *state;
+	GdkFrameClock *clock;
+
+	clock = gtk_widget_get_frame_clock (widget);
+	if (!clock)
+		return;
+
+	state = g_new0 (FrameState, 1);
+	state->stats = user_data;
+
+	/* The state goes away with the frame clock */
+	g_signal_connect (clock, "before-paint", G_CALLBACK (frame_before_paint_cb), state);
+	g_signal_connect_after (clock, "layout", G_CALLBACK (frame_layout_cb), state);
+	g_signal_connect_after (clock, "paint", G_CALLBACK (frame_paint_cb), state);
+	g_signal_connect_data (clock, "after-paint", G_CALLBACK (frame_after_paint_cb),
+                           state, (GClosureNotify) g_free, G_CONNECT_AFTER);
+}
+
+/* Collects frame times of @toplevel under @name, a static string shared
+ * by all windows of the same kind. */
+void
+greeter_profile_track_frames (GtkWidget *toplevel, const gchar *name)
+{
+	FrameStats *stats;
+
+	if (!frame_timing_enabled)
+		return;
+
+	if (!frame_stats)
+		frame_stats = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+	stats = g_hash_table_lookup (frame_stats, name);
+	if (!stats) {
+		stats = g_new0 (FrameStats, 1);
+		g_hash_table_insert (frame_stats, (gpointer) name, stats);
+	}
+
+	g_signal_connect_after (toplevel, "realize", G_CALLBACK (frame_track_realize_cb), stats);
+	if (gtk_widget_get_realized (toplevel))
+		frame_track_realize_cb (toplevel, stats);
+}
+
+static gchar *
+frame_histogram_to_string (const guint *histogram)
+{
+	guint i;
+	GString *string = g_string_new (NULL);
+
+	for (i = 0; i < N_FRAME_BUCKETS; i++) {
+		if (frame_buckets[i] == G_MAXINT)
+			g_string_append_printf (string, " >=%d:%u", frame_buckets[i - 1], histogram[i]);
+		else
+			g_string_append_printf (string, " <%d:%u", frame_buckets[i], histogram[i]);
+	}
+
+	return g_string_free (string, FALSE);
+}
+
+void
+greeter_profile_report_frames (void)
+{
+	gpointer key, value;
+	GHashTableIter iter;
+
+	if (!frame_timing_enabled || !frame_stats)
+		return;
+
+	g_hash_table_iter_init (&iter, frame_stats);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		gchar *layout, *paint, *total;
+		FrameStats *stats = value;
+
+		layout = frame_histogram_to_string (stats->layout);
+		paint = frame_histogram_to_string (stats->paint);
+		total = frame_histogram_to_string (stats->total);
+
+		g_message ("[Profile] %s: %u frames, ms histograms: layout%s, paint%s, total%s",
+                   (const gchar *) key, stats->frames, layout, paint, total);
+
+		g_free (layout);
+		g_free (paint);
+		g_free (total);
+	}
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef __GREETER_PROFILE_H__
+#define __GREETER_PROFILE_H__
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+void      greeter_profile_init    (gint64       start_time);
+gboolean  greeter_profile_enabled (void);
+
+void      greeter_profile_mark    (const gchar *what);
+void      greeter_profile_elapsed (const gchar *what,
+                                   gint64       since);
+
+gsize     greeter_profile_get_rss (void);
+
+void      greeter_profile_start_leak_check (void);
+void      greeter_profile_report_objects   (void);
+
+void      greeter_profile_track_frames  (GtkWidget   *toplevel,
+                                         const gchar *name);
+void      greeter_profile_report_frames (void);
+
+G_END_DECLS
+
+#endif /* __GREETER_PROFILE_H__ */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <time.h>
+#include <gtk/gtk.h>
+
+#include "greeter-spinner.h"
+#include "greeter-profile.h"
+#include "greeterconfiguration.h"
+
+
+/* Throttled mode turns the icon in SPINNER_STEPS steps per second */
+#define SPINNER_STEPS  12
+
+static gint         spinner_mode = -1;
+static GSList      *spinners = NULL;
+static guint        spinner_step = 0;
+static guint        spinner_timeout_id = 0;
+static guint        spinner_active = 0;
+
+static gint64       spinner_start_time = 0;
+static gint64       spinner_start_cpu = 0;
+
+
+static SpinnerMode
+get_spinner_mode (void)
+{
+	if (spinner_mode < 0)
+		spinner_mode = config_get_enum (NULL, CONFIG_KEY_SPINNER_MODE, SPINNER_MODE_NORMAL,
+                                        "normal", SPINNER_MODE_NORMAL,
+                                        "throttled", SPINNER_MODE_THROTTLED,
+                                        "static", SPINNER_MODE_STATIC,
+                                        NULL);
+
+	return spinner_mode;
+}
+
+/* CPU time used by the whole greeter, in microseconds */
+static gint64
+get_process_cpu_time (void)
+{
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+		return 0;
+
+	return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static void
+spinner_set_step (GtkWidget *spinner, guint step)
+{
+	gchar *name;
+	GtkStyleContext *style = gtk_widget_get_style_context (spinner);
+
+	name = g_strdup_printf ("spin-step-%u", spinner_step);
+	gtk_style_context_remove_class (style, name);
+	g_free (name);
+
+	name = g_strdup_printf ("spin-step-%u", step);
+	gtk_style_context_add_class (style, name);
+	g_free (name);
+}
+
+static gboolean
+spinner_step_cb (gpointer user_data)
+{
+	GSList *l;
+	guint step = (spinner_step + 1) % SPINNER_STEPS;
+
+	for (l = spinners; l; l = l->next)
+		spinner_set_step (l->data, step);
+	spinner_step = step;
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+spinner_active_changed_cb (GObject    *object,
+                           GParamSpec *pspec,
+                           gpointer    user_data)
+{
+	gboolean active;
+
+	g_object_get (object, "active", &active, NULL);
+
+	if (active) {
+		if (spinner_active++ > 0)
+			return;
+
+		spinner_start_time = g_get_monotonic_time ();
+		spinner_start_cpu = get_process_cpu_time ();
+
+		if (get_spinner_mode () == SPINNER_MODE_THROTTLED && !spinner_timeout_id)
+			spinner_timeout_id = g_timeout_add (1000 / SPINNER_STEPS, spinner_step_cb, NULL);
+	} else {
+		if (spinner_active == 0 || --spinner_active > 0)
+			return;
+
+		g_clear_handle_id (&spinner_timeout_id, g_source_remove);
+
+		if (greeter_profile_enabled ()) {
+			g_message ("[Profile] Spinner: %.1f ms CPU over %.1f s",
+                       (get_process_cpu_time () - spinner_start_cpu) / 1000.0,
+                       (g_get_monotonic_time () - spinner_start_time) / (gdouble) G_USEC_PER_SEC);
+		}
+	}
+}
+
+static void
+spinner_destroy_cb (GtkWidget *spinner, gpointer user_data)
+{
+	spinners = g_slist_remove (spinners, spinner);
+}
+
+/* Installs the style overrides for the configured spinner mode */
+void
+greeter_spinner_init (GdkScreen *screen)
+{
+	guint i;
+	GString *css;
+	GtkCssProvider *provider;
+
+	if (get_spinner_mode () == SPINNER_MODE_NORMAL)
+		return;
+
+	css = g_string_new ("spinner:checked { animation: none; }\n");
+
+	if (get_spinner_mode () == SPINNER_MODE_THROTTLED) {
+		for (i = 1; i < SPINNER_STEPS; i++)
+			g_string_append_printf (css, "spinner.spin-step-%u:checked { -gtk-icon-transform: rotate(%udeg); }\n",
+                                    i, i * 360 / SPINNER_STEPS);
+	}
+
+	provider = gtk_css_provider_new ();
+	gtk_css_provider_load_from_data (provider, css->str, -1, NULL);
+	gtk_style_context_add_provider_for_screen (screen,
+                                               GTK_STYLE_PROVIDER (provider),
+                                               GTK_STYLE_PROVIDER_PRIORITY_APPLICATION + 1);
+	g_object_unref (provider);
+	g_string_free (css, TRUE);
+}
+
+/* Makes @spinner, a GtkSpinner, follow the configured spinner mode */
+void
+greeter_spinner_attach (GtkWidget *spinner)
+{
+	g_return_if_fail (GTK_IS_SPINNER (spinner));
+
+	spinners = g_slist_prepend (spinners, spinner);
+
+	g_signal_connect (spinner, "notify::active",
+                      G_CALLBACK (spinner_active_changed_cb), NULL);
+	g_signal_connect (spinner, "destroy",
+                      G_CALLBACK (spinner_destroy_cb), NULL);
+}
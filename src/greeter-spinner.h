@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef __GREETER_SPINNER_H__
+#define __GREETER_SPINNER_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+	SPINNER_MODE_NORMAL,
+	SPINNER_MODE_THROTTLED,
+	SPINNER_MODE_STATIC
+} SpinnerMode;
+
+void  greeter_spinner_init   (GdkScreen *screen);
+void  greeter_spinner_attach (GtkWidget *spinner);
+
+G_END_DECLS
+
+#endif /* __GREETER_SPINNER_H__ */
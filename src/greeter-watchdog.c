@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "greeter-watchdog.h"
+#include "greeterconfiguration.h"
+
+
+/* Period of the main loop heartbeat, in milliseconds */
+#define WATCHDOG_INTERVAL  50
+
+#define DEFAULT_PHASE      "main-loop"
+
+/* Upper bounds of the stall histogram buckets, in milliseconds */
+static const gint stall_buckets[] = { 100, 250, 500, 1000, 2000, G_MAXINT };
+#define N_STALL_BUCKETS G_N_ELEMENTS (stall_buckets)
+
+typedef struct
+{
+	guint  count;
+	gint64 worst;
+	guint  histogram[N_STALL_BUCKETS];
+} StallStats;
+
+static gboolean     watchdog_enabled = FALSE;
+static gint64       watchdog_threshold = 0;
+
+/* Shared with the watchdog thread */
+static GMutex       watchdog_lock;
+static gint64       watchdog_last_beat = 0;
+static const gchar *watchdog_phase = DEFAULT_PHASE;
+static const gchar *watchdog_stalled_phase = NULL;
+
+/* Phase => <StallStats*>, main thread only */
+static GHashTable  *watchdog_stats = NULL;
+
+
+static void
+stall_record (const gchar *phase, gint64 duration)
+{
+	guint i;
+	StallStats *stats;
+
+	stats = g_hash_table_lookup (watchdog_stats, phase);
+	if (!stats) {
+		stats = g_new0 (StallStats, 1);
+		g_hash_table_insert (watchdog_stats, (gpointer) phase, stats);
+	}
+
+	for (i = 0; i < N_STALL_BUCKETS; i++) {
+		if (duration < stall_buckets[i]) {
+			stats->histogram[i]++;
+			break;
+		}
+	}
+
+	stats->count++;
+	if (duration > stats->worst) {
+		stats->worst = duration;
+		g_warning ("[Watchdog] Main loop stalled for %" G_GINT64_FORMAT " ms in %s", duration, phase);
+	} else {
+		g_debug ("[Watchdog] Main loop stalled for %" G_GINT64_FORMAT " ms in %s", duration, phase);
+	}
+}
+
+static gboolean
+heartbeat_cb (gpointer user_data)
+{
+	gint64 now, gap;
+	const gchar *phase;
+
+	now = g_get_monotonic_time ();
+
+	g_mutex_lock (&watchdog_lock);
+	gap = (now - watchdog_last_beat) / 1000 - WATCHDOG_INTERVAL;
+	phase = watchdog_stalled_phase ? watchdog_stalled_phase : watchdog_phase;
+	watchdog_stalled_phase = NULL;
+	watchdog_last_beat = now;
+	g_mutex_unlock (&watchdog_lock);
+
+	if (gap >= watchdog_threshold)
+		stall_record (phase, gap);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* Notes the phase while the stall is still in progress: by the time the
+ * heartbeat runs again the blocking call has returned and left its phase. */
+static gpointer
+watchdog_thread (gpointer data)
+{
+	while (TRUE) {
+		g_usleep (WATCHDOG_INTERVAL * 1000);
+
+		g_mutex_lock (&watchdog_lock);
+		if (!watchdog_stalled_phase &&
+            (g_get_monotonic_time () - watchdog_last_beat) / 1000 > watchdog_threshold)
+			watchdog_stalled_phase = watchdog_phase;
+		g_mutex_unlock (&watchdog_lock);
+	}
+
+	return NULL;
+}
+
+void
+greeter_watchdog_start (void)
+{
+	gint threshold;
+	GThread *thread;
+
+	threshold = config_get_int (NULL, CONFIG_KEY_STALL_THRESHOLD, 0);
+	if (threshold <= 0 || watchdog_enabled)
+		return;
+
+	watchdog_enabled = TRUE;
+	watchdog_threshold = threshold;
+	watchdog_last_beat = g_get_monotonic_time ();
+	watchdog_stats = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+	g_timeout_add (WATCHDOG_INTERVAL, heartbeat_cb, NULL);
+
+	thread = g_thread_new ("watchdog", watchdog_thread, NULL);
+	g_thread_unref (thread);
+}
+
+/* Tags the main loop with @phase, which must be a static string, until
+ * greeter_watchdog_leave() restores the returned previous phase. */
+const gchar *
+greeter_watchdog_enter (const gchar *phase)
+{
+	const gchar *previous;
+
+	if (!watchdog_enabled)
+		return NULL;
+
+	g_mutex_lock (&watchdog_lock);
+	previous = watchdog_phase;
+	watchdog_phase = phase;
+	g_mutex_unlock (&watchdog_lock);
+
+	return previous;
+}
+
+void
+greeter_watchdog_leave (const gchar *previous)
+{
+	if (!watchdog_enabled)
+		return;
+
+	g_mutex_lock (&watchdog_lock);
+	watchdog_phase = previous ? previous : DEFAULT_PHASE;
+	g_mutex_unlock (&watchdog_lock);
+}
+
+void
+greeter_watchdog_report (void)
+{
+	guint i;
+	GString *line;
+	gpointer key, value;
+	GHashTableIter iter;
+
+	if (!watchdog_enabled)
+		return;
+
+	line = g_string_new (NULL);
+
+	g_hash_table_iter_init (&iter, watchdog_stats);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		StallStats *stats = value;
+
+		g_string_truncate (line, 0);
+		for (i = 0; i < N_STALL_BUCKETS; i++) {
+			if (stall_buckets[i] == G_MAXINT)
+				g_string_append_printf (line, " >=%d:%u", stall_buckets[i - 1], stats->histogram[i]);
+			else
+				g_string_append_printf (line, " <%d:%u", stall_buckets[i], stats->histogram[i]);
+		}
+
+		g_message ("[Watchdog] %s: %u stalls, worst %" G_GINT64_FORMAT " ms, ms histogram%s",
+                   (const gchar *) key, stats->count, stats->worst, line->str);
+	}
+
+	g_string_free (line, TRUE);
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef __GREETER_WATCHDOG_H__
+#define __GREETER_WATCHDOG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void         greeter_watchdog_start  (void);
+
+const gchar *greeter_watchdog_enter  (const gchar *phase);
+void         greeter_watchdog_leave  (const gchar *previous);
+
+void         greeter_watchdog_report (void);
+
+G_END_DECLS
+
+#endif /* __GREETER_WATCHDOG_H__ */
@@ -23,6 +23,9 @@
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <lightdm.h>
 #include <upower.h>
@@ -35,20 +38,61 @@
 #include "splash-window.h"
 #include "indicator-button.h"
 #include "greeterconfiguration.h"
+#include "greeter-profile.h"
+#include "greeter-watchdog.h"
+#include "greeter-spinner.h"
+#include "greeter-monitor-topology.h"
+#include "greeter-icons.h"
+#include "greeter-memory.h"
 #include "greeter-message-dialog.h"
 #include "greeter-password-settings-dialog.h"
 
 #define LOGIN_TIMEOUT 60
+/* Hidden message dialogs kept for reuse */
+#define DIALOG_POOL_SIZE 2
+
+#define DBUS_CALL_TIMEOUT 1000
 #define	PAM_CLEAN_AUTH	"/lib/x86_64-linux-gnu/security/pam_clean_auth.so"
 #define	AGENT_CONF	"/etc/gooroom/agent/Agent.conf"
+#define	CLEAN_MODE_FLAG	"/tmp/.cleanmode"
 
 enum {
 	SYSTEM_SHUTDOWN,
 	SYSTEM_RESTART,
 	SYSTEM_SUSPEND,
-	SYSTEM_HIBERNATE
+	SYSTEM_HIBERNATE,
+	SYSTEM_LAST
 };
 
+/* logind methods, indexed by the enum above */
+static const gchar *power_query_methods[SYSTEM_LAST] = {
+	"CanPowerOff", "CanReboot", "CanSuspend", "CanHibernate" };
+static const gchar *power_action_methods[SYSTEM_LAST] = {
+	"PowerOff", "Reboot", "Suspend", "Hibernate" };
+/* logind properties that change the answers of power_query_methods: an
+ * inhibitor lock turns a "yes" into "challenge" or "no" */
+static const gchar *power_query_properties[] = {
+	"BlockInhibited", NULL };
+
+typedef struct
+{
+	GreeterWindow *window;
+	gint type;
+} PowerQuery;
+
+/* What loading an indicator module cost, owned by its IndicatorObject */
+typedef struct
+{
+	gdouble load_ms;
+	gssize  rss;    /* RSS growth while loading */
+} IndicatorLoad;
+
+typedef struct
+{
+	GtkWidget       *button;
+	IndicatorObject *io;
+} IndicatorEntry;
+
 enum
 {
 	POSITION_CHANGED,
@@ -80,26 +124,62 @@ struct _GreeterWindowPrivate
 	GtkWidget *btn_restart;
 	GtkWidget *btn_suspend;
 	GtkWidget *btn_hibernate;
+	GtkWidget *img_shutdown;
+	GtkWidget *img_restart;
+	GtkWidget *img_suspend;
+	GtkWidget *img_hibernate;
 	GtkWidget *pw_dialog;
 	GtkWidget *spinner;
 	GtkWidget *switch_indicator;
+	GtkWidget *switch_menu;
+
+	GdkRectangle active_geometry;
+	GSList *dialog_pool;
+	guint switch_menu_serial;
+	guint switch_menu_free_id;
 
 	SplashWindow *splash;
 
 	LightDMGreeter *lightdm;
 
-	GPtrArray *devices;
-	UpClient  *up_client;
+	GPtrArray    *devices;
+	UpClient     *up_client;
+	GCancellable *up_cancellable;
+
+	/* indicator registry */
+	GHashTable *indicator_entries;  /* IndicatorObjectEntry* => IndicatorEntry* */
+	GHashTable *battery_devices;    /* UpDevice* => GtkImage* */
+	GSList     *pending_indicators; /* packed, shown in one batch */
+	guint       indicator_flush_id;
+
+	/* power capabilities, probed asynchronously */
+	GDBusProxy   *login1_proxy;
+	GCancellable *power_cancellable;
+	gboolean      can_power[SYSTEM_LAST];
+	gboolean      command_pending; /* counting logged in users */
+
+	/* session and language of the user being authenticated */
+	GCancellable *accounts_cancellable;
 
 	gboolean prompted;
 	gboolean prompt_active;
 	gboolean have_pam_error;
 	gboolean changing_password;
 
+	/* speculative authentication */
+	gboolean speculative_auth;
+	gboolean speculating;
+	gboolean cancelling;    /* a cancelled speculative conversation has not ended yet */
+	gboolean speculation_ended; /* before submission, its messages are kept */
+
 	/* clean mode */
 	GtkWidget *cm_box;
 	GtkSwitch *cleanmode_switch;
 	gboolean cleanmode_flag;
+	gboolean cleanmode_allowed;
+	gboolean cleanmode_busy;
+	GCancellable *cleanmode_cancellable;
+	GFileMonitor *agent_conf_monitor;
 
 	gchar *id;
 	gchar *pw;
@@ -111,6 +191,16 @@ struct _GreeterWindowPrivate
 
 	guint  splash_timeout_id;
 
+	/* clock */
+	GtkWidget *clock_label;
+	gchar     *clock_format;
+	gchar     *clock_text;
+	gboolean   clock_seconds;
+	guint      clock_timeout_id;
+
+	/* monotonic time of the last login submission, for profiling */
+	gint64 login_time;
+
 	gint changing_password_step;
 };
 
@@ -182,6 +272,214 @@ set_language (GreeterWindow *window, const gchar *language)
 	priv->current_language = g_strdup (language);
 }
 
+/* Look up the session and language of a single account through
+ * AccountsService instead of lightdm_user_list_get_user_by_name(), which
+ * enumerates every account of the (possibly network backed) directory.
+ * Blocks on the bus, only called from worker threads. */
+static gboolean
+lookup_user_settings (const gchar   *username,
+                      GCancellable  *cancellable,
+                      gchar        **session,
+                      gchar        **language)
+{
+	GVariant *result, *value, *props;
+	GDBusConnection *bus;
+	const gchar *object_path;
+
+	*session = NULL;
+	*language = NULL;
+
+	bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, cancellable, NULL);
+	if (!bus)
+		return FALSE;
+
+	result = g_dbus_connection_call_sync (bus,
+                                          "org.freedesktop.Accounts",
+                                          "/org/freedesktop/Accounts",
+                                          "org.freedesktop.Accounts",
+                                          "FindUserByName",
+                                          g_variant_new ("(s)", username),
+                                          G_VARIANT_TYPE ("(o)"),
+                                          G_DBUS_CALL_FLAGS_NONE,
+                                          DBUS_CALL_TIMEOUT,
+                                          cancellable, NULL);
+	if (!result) {
+		g_object_unref (bus);
+		return FALSE;
+	}
+
+	g_variant_get (result, "(&o)", &object_path);
+
+	value = g_dbus_connection_call_sync (bus,
+                                         "org.freedesktop.Accounts",
+                                         object_path,
+                                         "org.freedesktop.DBus.Properties",
+                                         "GetAll",
+                                         g_variant_new ("(s)", "org.freedesktop.Accounts.User"),
+                                         G_VARIANT_TYPE ("(a{sv})"),
+                                         G_DBUS_CALL_FLAGS_NONE,
+                                         DBUS_CALL_TIMEOUT,
+                                         cancellable, NULL);
+	g_variant_unref (result);
+	g_object_unref (bus);
+
+	if (!value)
+		return FALSE;
+
+	props = g_variant_get_child_value (value, 0);
+	g_variant_lookup (props, "XSession", "s", session);
+	g_variant_lookup (props, "Language", "s", language);
+	g_variant_unref (props);
+	g_variant_unref (value);
+
+	if (*session && **session == '\0')
+		g_clear_pointer (session, g_free);
+	if (*language && **language == '\0')
+		g_clear_pointer (language, g_free);
+
+	return TRUE;
+}
+
+typedef struct
+{
+	gchar *username;
+	gchar *session;
+	gchar *language;
+} UserSettings;
+
+static void
+user_settings_free (UserSettings *settings)
+{
+	g_free (settings->username);
+	g_free (settings->session);
+	g_free (settings->language);
+	g_free (settings);
+}
+
+static void
+user_settings_thread (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+	UserSettings *settings = task_data;
+
+	g_task_return_boolean (task, lookup_user_settings (settings->username, cancellable,
+                                                       &settings->session, &settings->language));
+}
+
+static void
+user_settings_cb (GObject      *source,
+                  GAsyncResult *res,
+                  gpointer      user_data)
+{
+	gboolean found;
+	GError *error = NULL;
+	UserSettings *settings;
+	GreeterWindow *window = GREETER_WINDOW (source);
+	GreeterWindowPrivate *priv = window->priv;
+
+	found = g_task_propagate_boolean (G_TASK (res), &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
+	}
+	g_clear_error (&error);
+
+	/* Only for the conversation it was started for */
+	settings = g_task_get_task_data (G_TASK (res));
+	if (g_strcmp0 (settings->username,
+                   lightdm_greeter_get_authentication_user (priv->lightdm)) != 0)
+		return;
+
+	if (found) {
+		if (!priv->current_session)
+			set_session (window, settings->session);
+		if (!priv->current_language)
+			set_language (window, settings->language);
+	} else {
+		set_session (window, NULL);
+		set_language (window, NULL);
+	}
+}
+
+/* The result is applied when it arrives, long before the PAM conversation
+ * gets to starting the session */
+static void
+user_settings_lookup (GreeterWindow *window, const gchar *username)
+{
+	GTask *task;
+	UserSettings *settings;
+	GreeterWindowPrivate *priv = window->priv;
+
+	if (priv->accounts_cancellable) {
+		g_cancellable_cancel (priv->accounts_cancellable);
+		g_clear_object (&priv->accounts_cancellable);
+	}
+
+	if (!username)
+		return;
+
+	priv->accounts_cancellable = g_cancellable_new ();
+
+	settings = g_new0 (UserSettings, 1);
+	settings->username = g_strdup (username);
+
+	task = g_task_new (window, priv->accounts_cancellable, user_settings_cb, NULL);
+	g_task_set_task_data (task, settings, (GDestroyNotify) user_settings_free);
+	g_task_run_in_thread (task, user_settings_thread);
+	g_object_unref (task);
+}
+
+/* Count users, other than the greeter itself, that have a logind session.
+ * Blocks on the bus, only called from worker threads. */
+static gint
+get_logged_in_users (GCancellable *cancellable)
+{
+	GVariant *result;
+	GVariantIter *iter;
+	GDBusConnection *bus;
+	GHashTable *users;
+	const gchar *name;
+	guint32 uid;
+	gint n_users;
+
+	bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, cancellable, NULL);
+	if (!bus)
+		return 0;
+
+	result = g_dbus_connection_call_sync (bus,
+                                          "org.freedesktop.login1",
+                                          "/org/freedesktop/login1",
+                                          "org.freedesktop.login1.Manager",
+                                          "ListSessions",
+                                          NULL,
+                                          G_VARIANT_TYPE ("(a(susso))"),
+                                          G_DBUS_CALL_FLAGS_NONE,
+                                          DBUS_CALL_TIMEOUT,
+                                          cancellable, NULL);
+	g_object_unref (bus);
+
+	if (!result)
+		return 0;
+
+	users = g_hash_table_new (g_str_hash, g_str_equal);
+
+	g_variant_get (result, "(a(susso))", &iter);
+	while (g_variant_iter_next (iter, "(&su&s&s&o)", NULL, &uid, &name, NULL, NULL)) {
+		if (uid != getuid ())
+			g_hash_table_add (users, (gpointer) name);
+	}
+	g_variant_iter_free (iter);
+
+	n_users = g_hash_table_size (users);
+
+	g_hash_table_destroy (users);
+	g_variant_unref (result);
+
+	return n_users;
+}
+
 static void
 start_authentication (GreeterWindow *window, const gchar *username)
 {
@@ -191,6 +489,10 @@ start_authentication (GreeterWindow *window, const gchar *username)
 	priv->prompted = FALSE;
 	priv->prompt_active = FALSE;
 	priv->have_pam_error = FALSE;
+	priv->speculating = FALSE;
+	priv->speculation_ended = FALSE;
+	/* liblightdm drops the end of the cancelled conversation once a new one starts */
+	priv->cancelling = FALSE;
 
 	if (priv->pending_questions)
 	{
@@ -198,6 +500,9 @@ start_authentication (GreeterWindow *window, const gchar *username)
 		priv->pending_questions = NULL;
 	}
 
+	/* A lookup for the previous user is of no use anymore */
+	user_settings_lookup (window, NULL);
+
 	if (g_strcmp0 (username, "*other") == 0)
 	{
 #ifdef HAVE_LIBLIGHTDMGOBJECT_1_19_2
@@ -216,21 +521,7 @@ start_authentication (GreeterWindow *window, const gchar *username)
 	}
 	else
 	{
-		LightDMUser *user;
-
-		user = lightdm_user_list_get_user_by_name (lightdm_user_list_get_instance (), username);
-		if (user)
-		{
-			if (!priv->current_session)
-				set_session (window, lightdm_user_get_session (user));
-			if (!priv->current_language)
-				set_language (window, lightdm_user_get_language (user));
-		}
-		else
-		{
-			set_session (window, NULL);
-			set_language (window, NULL);
-		}
+		user_settings_lookup (window, username);
 #ifdef HAVE_LIBLIGHTDMGOBJECT_1_19_2
 		lightdm_greeter_authenticate (greeter, username, NULL);
 #else
@@ -239,6 +530,88 @@ start_authentication (GreeterWindow *window, const gchar *username)
 	}
 }
 
+/* Speculative authentication:
+ * begin the PAM conversation for the typed username in the background once
+ * the password entry gets the focus, so that the password prompt is already
+ * pending when the user submits. Messages of a speculative conversation are
+ * queued and only processed after submission, also when it ended before.
+ *
+ * Every abandoned conversation may count as a failed attempt for
+ * pam_faillock, so a speculative conversation is never cancelled while the
+ * username stays the same, and none is started while another one runs. */
+static void
+start_speculative_authentication (GreeterWindow *window)
+{
+	const gchar *id;
+	GreeterWindowPrivate *priv = window->priv;
+
+	if (!priv->speculative_auth)
+		return;
+
+	if (priv->changing_password || priv->pw_dialog ||
+        !gtk_widget_get_sensitive (priv->id_entry) ||
+        !gtk_widget_has_focus (priv->pw_entry))
+		return;
+
+	if (lightdm_greeter_get_in_authentication (priv->lightdm) ||
+        priv->cancelling)
+		return;
+
+	id = gtk_entry_get_text (GTK_ENTRY (priv->id_entry));
+	if (strlen (id) == 0)
+		return;
+
+	/* Its result is waiting for the submission */
+	if (priv->speculation_ended &&
+        g_strcmp0 (lightdm_greeter_get_authentication_user (priv->lightdm), id) == 0)
+		return;
+
+	g_debug ("Starting speculative authentication for %s", id);
+
+	start_authentication (window, id);
+	priv->speculating = TRUE;
+}
+
+static void
+cancel_speculative_authentication (GreeterWindow *window)
+{
+	GreeterWindowPrivate *priv = window->priv;
+
+	if (!priv->speculating)
+		return;
+
+	priv->prompted = FALSE;
+	priv->prompt_active = FALSE;
+
+	if (priv->pending_questions) {
+		g_slist_free_full (priv->pending_questions, (GDestroyNotify) pam_message_finalize);
+		priv->pending_questions = NULL;
+	}
+
+	priv->speculating = FALSE;
+
+	/* Until its authentication-complete arrives the conversation still
+	 * looks in progress, but it must never be reused */
+	if (lightdm_greeter_get_in_authentication (priv->lightdm)) {
+		priv->cancelling = TRUE;
+#ifdef HAVE_LIBLIGHTDMGOBJECT_1_19_2
+		lightdm_greeter_cancel_authentication (priv->lightdm, NULL);
+#else
+		lightdm_greeter_cancel_authentication (priv->lightdm);
+#endif
+	}
+}
+
+static gboolean
+pw_entry_focus_in_cb (GtkWidget     *widget,
+                      GdkEventFocus *event,
+                      gpointer       user_data)
+{
+	start_speculative_authentication (GREETER_WINDOW (user_data));
+
+	return FALSE;
+}
+
 static void
 password_settings_dialog_response_cb (GtkDialog *dialog,
                                       gint       response,
@@ -274,6 +647,52 @@ password_settings_dialog_response_cb (GtkDialog *dialog,
 	start_authentication (window, lightdm_greeter_get_authentication_user (priv->lightdm));
 }
 
+/* Takes a realized dialog from the pool, or builds one if all are in use */
+static GtkWidget *
+message_dialog_acquire (GreeterWindow *window,
+                        const gchar   *icon,
+                        const gchar   *title,
+                        const gchar   *message)
+{
+	GtkWidget *dialog, *toplevel;
+	GreeterWindowPrivate *priv = window->priv;
+
+	toplevel = gtk_widget_get_toplevel (GTK_WIDGET (window));
+
+	if (!priv->dialog_pool)
+		return greeter_message_dialog_new (GTK_WINDOW (toplevel), icon, title, message);
+
+	dialog = priv->dialog_pool->data;
+	priv->dialog_pool = g_slist_delete_link (priv->dialog_pool, priv->dialog_pool);
+
+	/* The login panel may have moved to another monitor since last use */
+	gtk_window_set_transient_for (GTK_WINDOW (dialog), GTK_WINDOW (toplevel));
+	gtk_window_set_position (GTK_WINDOW (dialog), GTK_WIN_POS_CENTER_ON_PARENT);
+
+	greeter_message_dialog_set_icon (GREETER_MESSAGE_DIALOG (dialog), icon);
+	greeter_message_dialog_set_title (GREETER_MESSAGE_DIALOG (dialog), title);
+	greeter_message_dialog_set_message (GREETER_MESSAGE_DIALOG (dialog), message);
+
+	return dialog;
+}
+
+static void
+message_dialog_release (GreeterWindow *window, GtkWidget *dialog)
+{
+	GreeterWindowPrivate *priv = window->priv;
+
+	if (greeter_memory_is_low () ||
+        g_slist_length (priv->dialog_pool) >= DIALOG_POOL_SIZE) {
+		gtk_widget_destroy (dialog);
+		return;
+	}
+
+	gtk_widget_hide (dialog);
+	greeter_message_dialog_reset (GREETER_MESSAGE_DIALOG (dialog));
+
+	priv->dialog_pool = g_slist_prepend (priv->dialog_pool, dialog);
+}
+
 static void
 login_error_dialog_response_cb (GtkDialog *dialog,
                                 gint       response,
@@ -284,7 +703,9 @@ login_error_dialog_response_cb (GtkDialog *dialog,
 
 	gtk_entry_set_text (GTK_ENTRY (priv->pw_entry), "");
 	gtk_widget_grab_focus (priv->pw_entry);
-	gtk_widget_destroy (GTK_WIDGET (dialog));
+
+	g_signal_handlers_disconnect_by_func (dialog, login_error_dialog_response_cb, window);
+	message_dialog_release (window, GTK_WIDGET (dialog));
 }
 
 static void
@@ -294,10 +715,10 @@ show_login_error_dialog (GreeterWindow *window,
 {
 	GtkWidget *dialog;
 
-	dialog = greeter_message_dialog_new (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (window))),
-                                         "dialog-warning-symbolic.symbolic",
-                                         title,
-                                         message ? message : "");
+	dialog = message_dialog_acquire (window,
+                                     "dialog-warning-symbolic.symbolic",
+                                     title,
+                                     message ? message : "");
 
 	gtk_dialog_add_buttons (GTK_DIALOG (dialog), _("Ok"), GTK_RESPONSE_OK, NULL);
 	gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_OK);
@@ -320,16 +741,16 @@ run_warning_dialog (GreeterWindow *window,
 	gchar *response = NULL;
 	GreeterWindowPrivate *priv = window->priv;
 
-	dialog = greeter_message_dialog_new (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (window))),
-                                         "dialog-warning-symbolic.symbolic",
-                                         title,
-                                         message);
+	dialog = message_dialog_acquire (window,
+                                     "dialog-warning-symbolic.symbolic",
+                                     title,
+                                     message);
 
 	gtk_dialog_add_buttons (GTK_DIALOG (dialog), _("Ok"), GTK_RESPONSE_OK, NULL);
 	gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_OK);
 
 	gtk_dialog_run (GTK_DIALOG (dialog));
-	gtk_widget_destroy (dialog);
+	message_dialog_release (window, dialog);
 
 	if (data) {
 		if (g_str_equal (data, "CHPASSWD_FAILURE_OK")) {
@@ -397,10 +818,10 @@ run_password_changing_dialog (GreeterWindow *window,
 	GtkStyleContext *style = NULL;
 	GreeterWindowPrivate *priv = window->priv;
 
-	dialog = greeter_message_dialog_new (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (window))),
-                                         "dialog-password-symbolic",
-                                         title,
-                                         message);
+	dialog = message_dialog_acquire (window,
+                                     "dialog-password-symbolic",
+                                     title,
+                                     message);
 
 	yes_text = (yes) ? yes : _("Ok");
 	no_text = (no) ? no : _("Cancel");
@@ -419,7 +840,7 @@ run_password_changing_dialog (GreeterWindow *window,
 	gtk_widget_queue_draw (dialog);
 
 	res = gtk_dialog_run (GTK_DIALOG (dialog));
-	gtk_widget_destroy (dialog);
+	message_dialog_release (window, dialog);
 
 	if (res == GTK_RESPONSE_OK) {
 		priv->changing_password = TRUE;
@@ -466,10 +887,8 @@ hide_splash (GreeterWindow *window)
 
 	gtk_spinner_stop (GTK_SPINNER (priv->spinner));
 
-	if (priv->splash) {
-		splash_window_destroy (priv->splash);
-		priv->splash = NULL;
-	}
+	if (priv->splash)
+		splash_window_hide (priv->splash);
 }
 
 static void
@@ -477,11 +896,14 @@ show_splash (GreeterWindow *window, GtkWidget *parent)
 {
 	GreeterWindowPrivate *priv = window->priv;
 
-	hide_splash (window);
-
 	gtk_spinner_start (GTK_SPINNER (priv->spinner));
 
-	priv->splash = splash_window_new (GTK_WINDOW (parent));
+	/* Not placed on a monitor yet, build it now */
+	if (!priv->splash) {
+		priv->splash = splash_window_new (GTK_WINDOW (parent));
+		g_object_ref_sink (priv->splash);
+	}
+
 	splash_window_show (priv->splash);
 }
 
@@ -573,6 +995,15 @@ process_prompts (GreeterWindow *window)
 		PAMConversationMessage *message = (PAMConversationMessage *) priv->pending_questions->data;
 		priv->pending_questions = g_slist_remove (priv->pending_questions, (gconstpointer) message);
 
+		if (greeter_profile_enabled ()) {
+			/* e.g. "Duplicate Login Notification" out of "Duplicate Login Notification:..." */
+			gchar *what = g_strdup_printf ("PAM %s \"%.*s\"",
+                                           message->is_prompt ? "prompt" : "message",
+                                           (int) strcspn (message->text, ":\n"), message->text);
+			greeter_profile_elapsed (what, priv->login_time);
+			g_free (what);
+		}
+
 		const gchar *filter_msg_000 = "You are required to change your password immediately";
 		const gchar *filter_msg_010 = g_dgettext("Linux-PAM", "You are required to change your password immediately (administrator enforced)");
 		const gchar *filter_msg_020 = g_dgettext("Linux-PAM", "You are required to change your password immediately (password expired)");
@@ -956,6 +1387,8 @@ process_prompts (GreeterWindow *window)
 static void
 start_session (GreeterWindow *window)
 {
+	gboolean started;
+	const gchar *phase;
 	GreeterWindowPrivate *priv = window->priv;
 	LightDMGreeter *greeter = priv->lightdm;
 
@@ -968,7 +1401,14 @@ start_session (GreeterWindow *window)
 
 //	greeter_background_save_xroot (greeter_background);
 
-	if (!lightdm_greeter_start_session_sync (greeter, priv->current_session, NULL)) {
+	greeter_watchdog_report ();
+	greeter_profile_report_frames ();
+
+	phase = greeter_watchdog_enter ("start-session");
+	started = lightdm_greeter_start_session_sync (greeter, priv->current_session, NULL);
+	greeter_watchdog_leave (phase);
+
+	if (!started) {
 		run_warning_dialog (window, NULL, _("Failed to start session"), NULL);
 		start_authentication (window, lightdm_greeter_get_authentication_user (greeter));
 	}
@@ -983,6 +1423,10 @@ show_prompt_cb (LightDMGreeter    *greeter,
 	GreeterWindow *window = GREETER_WINDOW (user_data);
 	GreeterWindowPrivate *priv = window->priv;
 
+	/* Left over from a cancelled speculative conversation */
+	if (priv->cancelling)
+		return;
+
 	PAMConversationMessage *message_obj = g_new (PAMConversationMessage, 1);
 	if (message_obj)
 	{
@@ -992,7 +1436,7 @@ show_prompt_cb (LightDMGreeter    *greeter,
 		priv->pending_questions = g_slist_append (priv->pending_questions, message_obj);
 	}
 
-	if (!priv->prompt_active)
+	if (!priv->prompt_active && !priv->speculating)
 		process_prompts (window);
 }
 
@@ -1005,6 +1449,9 @@ show_message_cb (LightDMGreeter     *greeter,
 	GreeterWindow *window = GREETER_WINDOW (user_data);
 	GreeterWindowPrivate *priv = window->priv;
 
+	if (priv->cancelling)
+		return;
+
     PAMConversationMessage *message_obj = g_new (PAMConversationMessage, 1);
     if (message_obj)
     {
@@ -1014,19 +1461,23 @@ show_message_cb (LightDMGreeter     *greeter,
         priv->pending_questions = g_slist_append (priv->pending_questions, message_obj);
     }
 
-    if (!priv->prompt_active)
+    if (!priv->prompt_active && !priv->speculating)
         process_prompts (window);
 }
 
 static void
-authentication_complete_cb (LightDMGreeter *greeter,
-                            gpointer        user_data)
+authentication_finish (GreeterWindow *window)
 {
-	GreeterWindow *window = GREETER_WINDOW (user_data);
 	GreeterWindowPrivate *priv = window->priv;
+	LightDMGreeter *greeter = priv->lightdm;
 
 	post_login (window);
 
+	greeter_profile_elapsed (lightdm_greeter_get_is_authenticated (greeter) ?
+                             "Authentication succeeded" : "Authentication failed",
+                             priv->login_time);
+	priv->login_time = 0;
+
 	priv->prompt_active = FALSE;
 
 	if (priv->pending_questions) {
@@ -1076,7 +1527,40 @@ authentication_complete_cb (LightDMGreeter *greeter,
                                      _("Authentication Failure\n"
                                        "Please check the username and password and try again."));
 		}
+
+		/* Do not wait for the error dialog to be closed */
+		start_speculative_authentication (window);
+	}
+}
+
+static void
+authentication_complete_cb (LightDMGreeter *greeter,
+                            gpointer        user_data)
+{
+	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
+
+	/* A cancelled speculative conversation ended: drop it silently */
+	if (priv->cancelling) {
+		priv->cancelling = FALSE;
+		priv->prompted = FALSE;
+		priv->prompt_active = FALSE;
+		if (priv->pending_questions) {
+			g_slist_free_full (priv->pending_questions, (GDestroyNotify) pam_message_finalize);
+			priv->pending_questions = NULL;
+		}
+		return;
 	}
+
+	/* A speculative conversation ended before the user submitted, e.g.
+	 * the account is locked: its messages and result are shown then */
+	if (priv->speculating) {
+		priv->speculating = FALSE;
+		priv->speculation_ended = TRUE;
+		return;
+	}
+
+	authentication_finish (window);
 }
 
 //static void
@@ -1115,7 +1599,23 @@ try_to_login_system (GreeterWindow *window)
 {
 	GreeterWindowPrivate *priv = window->priv;
 
-	start_authentication (window, priv->id);
+	if (priv->speculation_ended &&
+        g_strcmp0 (lightdm_greeter_get_authentication_user (priv->lightdm), priv->id) == 0) {
+		/* The conversation started while the user was typing is over */
+		priv->speculation_ended = FALSE;
+		process_prompts (window);
+		authentication_finish (window);
+		return;
+	} else if (priv->speculating && !priv->cancelling &&
+               lightdm_greeter_get_in_authentication (priv->lightdm) &&
+               g_strcmp0 (lightdm_greeter_get_authentication_user (priv->lightdm), priv->id) == 0) {
+		/* Reuse the conversation started while the user was typing */
+		priv->speculating = FALSE;
+		process_prompts (window);
+	} else {
+		cancel_speculative_authentication (window);
+		start_authentication (window, priv->id);
+	}
 
 	while (!priv->prompted)
 		gtk_main_iteration ();
@@ -1145,6 +1645,8 @@ login_button_clicked_cb (GtkButton *widget,
 	GreeterWindow *window = GREETER_WINDOW (user_data);
 	GreeterWindowPrivate *priv = window->priv;
 
+	priv->login_time = g_get_monotonic_time ();
+
 	pre_login (window);
 
 	g_clear_pointer (&priv->id, g_free);
@@ -1156,15 +1658,144 @@ login_button_clicked_cb (GtkButton *widget,
 	try_to_login_system (window);
 }
 
+static void
+clean_mode_sw_update_sensitive (GreeterWindow *window)
+{
+	GreeterWindowPrivate *priv = window->priv;
+
+	gtk_widget_set_sensitive (GTK_WIDGET (priv->cleanmode_switch),
+                              priv->cleanmode_allowed && !priv->cleanmode_busy);
+}
+
+/* Same as "rm -rf", without following symlinks, @file included: a
+ * symlink is removed itself, never the directory it points to */
+static gboolean
+delete_recursive (GFile *file, GCancellable *cancellable, GError **error)
+{
+	GFileInfo *info;
+	GFileType type;
+	GFileEnumerator *enumerator;
+
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              cancellable, error);
+	if (!info)
+		return FALSE;
+
+	type = g_file_info_get_file_type (info);
+	g_object_unref (info);
+
+	if (type != G_FILE_TYPE_DIRECTORY)
+		return g_file_delete (file, cancellable, error);
+
+	enumerator = g_file_enumerate_children (file,
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            cancellable, NULL);
+	if (enumerator) {
+		while ((info = g_file_enumerator_next_file (enumerator, cancellable, NULL)) != NULL) {
+			GFile *child = g_file_get_child (file, g_file_info_get_name (info));
+			gboolean ok;
+
+			ok = delete_recursive (child, cancellable, error);
+
+			g_object_unref (child);
+			g_object_unref (info);
+
+			if (!ok) {
+				g_object_unref (enumerator);
+				return FALSE;
+			}
+		}
+		g_object_unref (enumerator);
+	}
+
+	return g_file_delete (file, cancellable, error);
+}
+
+static void
+clean_mode_flag_thread (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+	GFile *file;
+	GError *error = NULL;
+	gboolean state = GPOINTER_TO_INT (task_data);
+
+	if (state) {
+		if (g_mkdir_with_parents (CLEAN_MODE_FLAG, 0700) != 0) {
+			gint saved_errno = errno;
+			g_task_return_new_error (task, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                                     "Failed to create %s: %s", CLEAN_MODE_FLAG, g_strerror (saved_errno));
+			return;
+		}
+		g_task_return_boolean (task, TRUE);
+		return;
+	}
+
+	file = g_file_new_for_path (CLEAN_MODE_FLAG);
+	if (!delete_recursive (file, cancellable, &error) &&
+        !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+		g_task_return_error (task, error);
+	} else {
+		g_clear_error (&error);
+		g_task_return_boolean (task, TRUE);
+	}
+	g_object_unref (file);
+}
+
+static void
+clean_mode_flag_done_cb (GObject      *source,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+	gboolean state;
+	GError *error = NULL;
+	GreeterWindow *window = GREETER_WINDOW (source);
+	GreeterWindowPrivate *priv = window->priv;
+
+	state = GPOINTER_TO_INT (g_task_get_task_data (G_TASK (res)));
+
+	if (!g_task_propagate_boolean (G_TASK (res), &error)) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_error_free (error);
+			return;
+		}
+		g_warning ("Failed to change clean mode: %s", error->message);
+		g_error_free (error);
+
+		/* Show what is actually on disk */
+		state = g_file_test (CLEAN_MODE_FLAG, G_FILE_TEST_IS_DIR);
+		g_signal_handlers_block_by_func (priv->cleanmode_switch, cleanmode_flag_state_set_cb, window);
+		gtk_switch_set_active (priv->cleanmode_switch, state);
+		g_signal_handlers_unblock_by_func (priv->cleanmode_switch, cleanmode_flag_state_set_cb, window);
+	}
+
+	priv->cleanmode_flag = state;
+	priv->cleanmode_busy = FALSE;
+
+	gtk_switch_set_state (priv->cleanmode_switch, state);
+	clean_mode_sw_update_sensitive (window);
+}
+
 static gboolean
 cleanmode_flag_state_set_cb (GtkSwitch *sw_clean, gboolean state, gpointer user_data)
 {
-	if (state)
-		g_mkdir_with_parents ("/tmp/.cleanmode", 0700);
-	else
-		g_spawn_command_line_sync ("/bin/rm -rf /tmp/.cleanmode", NULL, NULL, NULL, NULL);
+	GTask *task;
+	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
 
-	return FALSE;
+	/* The switch state follows once the flag has been changed on disk */
+	priv->cleanmode_busy = TRUE;
+	clean_mode_sw_update_sensitive (window);
+
+	task = g_task_new (window, priv->cleanmode_cancellable, clean_mode_flag_done_cb, NULL);
+	g_task_set_task_data (task, GINT_TO_POINTER (state), NULL);
+	g_task_run_in_thread (task, clean_mode_flag_thread);
+	g_object_unref (task);
+
+	return TRUE;
 }
 
 static void
@@ -1264,19 +1895,38 @@ entry_removed (IndicatorObject *io, IndicatorObjectEntry *entry, gpointer user_d
 {
 	g_return_if_fail (entry != NULL);
 
-	GList *children, *l = NULL;
+	GtkWidget *button;
+	IndicatorEntry *registered;
 	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
 
-	children = gtk_container_get_children (GTK_CONTAINER (window->priv->indicator_box));
-	for (l = children; l; l = l->next) {
-		XfceIndicatorButton *child = XFCE_INDICATOR_BUTTON (l->data);
-		if (child && (xfce_indicator_button_get_entry (child) == entry)) {
-			xfce_indicator_button_destroy (child);
-			break;
-		}
-	}
+	registered = g_hash_table_lookup (priv->indicator_entries, entry);
+	if (!registered)
+		return;
 
-	g_list_free (children);
+	button = registered->button;
+	g_hash_table_remove (priv->indicator_entries, entry);
+	priv->pending_indicators = g_slist_remove (priv->pending_indicators, button);
+
+	xfce_indicator_button_destroy (XFCE_INDICATOR_BUTTON (button));
+}
+
+static gboolean
+indicator_flush_idle (gpointer user_data)
+{
+	GSList *l;
+	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
+
+	priv->indicator_flush_id = 0;
+
+	/* Show every button added since the last flush in a single relayout */
+	for (l = priv->pending_indicators; l; l = l->next)
+		gtk_widget_show (GTK_WIDGET (l->data));
+
+	g_clear_pointer (&priv->pending_indicators, g_slist_free);
+
+	return FALSE;
 }
 
 static void
@@ -1285,17 +1935,22 @@ entry_added (IndicatorObject *io, IndicatorObjectEntry *entry, gpointer user_dat
 	g_return_if_fail (entry != NULL);
 
 	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
 
 	if ((g_strcmp0 (entry->name_hint, "nm-applet") == 0) ||
         (find_app_indicators (entry->name_hint)))
 	{
 		GtkWidget *button;
+		IndicatorEntry *registered;
 		const gchar *io_name;
 
+		if (g_hash_table_contains (priv->indicator_entries, entry))
+			return;
+
 		io_name = g_object_get_data (G_OBJECT (io), "io-name");
 
 		button = xfce_indicator_button_new (io, io_name, entry);
-		gtk_box_pack_start (GTK_BOX (window->priv->indicator_box), button, FALSE, FALSE, 0);
+		gtk_box_pack_start (GTK_BOX (priv->indicator_box), button, FALSE, FALSE, 0);
 
 		if (entry->image != NULL)
 			xfce_indicator_button_set_image (XFCE_INDICATOR_BUTTON (button), entry->image);
@@ -1310,7 +1965,16 @@ entry_added (IndicatorObject *io, IndicatorObjectEntry *entry, gpointer user_dat
 				xfce_indicator_button_set_menu (XFCE_INDICATOR_BUTTON (button), entry->menu);
 		}
 
-		gtk_widget_show (button);
+		registered = g_new0 (IndicatorEntry, 1);
+		registered->button = button;
+		registered->io = io;
+		g_hash_table_insert (priv->indicator_entries, entry, registered);
+
+		priv->pending_indicators = g_slist_append (priv->pending_indicators, button);
+		if (!priv->indicator_flush_id)
+			priv->indicator_flush_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                                                        indicator_flush_idle,
+                                                        window, NULL);
 	}
 }
 
@@ -1320,12 +1984,27 @@ load_module (const gchar *name, GreeterWindow *window)
 	gchar                *path;
 	IndicatorObject      *io;
 	GList                *entries, *l = NULL;
+	gint64                start_time;
+	gsize                 start_rss;
+	IndicatorLoad        *load;
+
+	start_time = g_get_monotonic_time ();
+	start_rss = greeter_profile_get_rss ();
 
 	path = g_build_filename (INDICATOR_DIR, name, NULL);
 	io = indicator_object_new_from_file (path);
 	g_free (path);
 
-	g_object_set_data (G_OBJECT (io), "io-name", g_strdup (name));
+	if (!io) {
+		g_warning ("Failed to load indicator module: %s", name);
+		return;
+	}
+
+	g_object_set_data_full (G_OBJECT (io), "io-name", g_strdup (name), g_free);
+
+	/* Filled in below, once the entries are added as well */
+	load = g_new0 (IndicatorLoad, 1);
+	g_object_set_data_full (G_OBJECT (io), "io-load", load, g_free);
 
 	g_signal_connect (G_OBJECT (io),
                       INDICATOR_OBJECT_SIGNAL_ENTRY_ADDED, G_CALLBACK (entry_added), window);
@@ -1336,10 +2015,17 @@ load_module (const gchar *name, GreeterWindow *window)
 
 	for (l = entries; l; l = l->next) {
 		IndicatorObjectEntry *ioe = (IndicatorObjectEntry *)l->data;
-		entry_added (io, ioe, NULL);
+		entry_added (io, ioe, window);
 	}
 
 	g_list_free (entries);
+
+	load->load_ms = (g_get_monotonic_time () - start_time) / 1000.0;
+	if (start_rss > 0)
+		load->rss = (gssize) greeter_profile_get_rss () - (gssize) start_rss;
+
+	g_debug ("[Indicator] %s loaded in %.1f ms, RSS %+.1f KiB", name,
+             load->load_ms, load->rss / 1024.0);
 }
 
 static void
@@ -1363,52 +2049,62 @@ load_application_indicator (GreeterWindow *window)
 	}
 }
 
-static gchar *
+typedef struct
+{
+	UpClient  *client;
+	GPtrArray *devices;
+} UpClientData;
+
+/* Icon names indexed by charge level and by discharging/charging/charged */
+static const gchar *battery_icon_names[][3] = {
+	{ "battery-full",    "battery-full-charging",    "battery-full-charged" },
+	{ "battery-good",    "battery-good-charging",    "battery-good-charged" },
+	{ "battery-medium",  "battery-medium-charging",  "battery-medium-charged" },
+	{ "battery-low",     "battery-low-charging",     "battery-low-charged" },
+	{ "battery-caution", "battery-caution-charging", "battery-caution-charged" },
+};
+
+static const gchar *
 get_battery_icon_name (double percentage, UpDeviceState state)
 {
-	gchar *icon_name = NULL;
-	const gchar *bat_state;
+	gint level, bat_state;
 
 	switch (state)
 	{
 		case UP_DEVICE_STATE_CHARGING:
 		case UP_DEVICE_STATE_PENDING_CHARGE:
-			bat_state = "-charging";
+			bat_state = 1;
 			break;
 
 		case UP_DEVICE_STATE_DISCHARGING:
 		case UP_DEVICE_STATE_PENDING_DISCHARGE:
-			bat_state = "";
+			bat_state = 0;
 			break;
 
 		case UP_DEVICE_STATE_FULLY_CHARGED:
-			bat_state = "-charged";
+			bat_state = 2;
 			break;
 
 		case UP_DEVICE_STATE_EMPTY:
-			return g_strdup ("battery-empty");
+			return "battery-empty";
 
 		default:
-			bat_state = NULL;
-			break;
-	}
-	if (!bat_state) {
-		return g_strdup ("battery-error");
+			return "battery-error";
 	}
 
 	if (percentage >= 75) {
-		icon_name = g_strdup_printf ("battery-full%s", bat_state);
-	} else if (percentage >= 50 && percentage < 75) {
-		icon_name = g_strdup_printf ("battery-good%s", bat_state);
-	} else if (percentage >= 25 && percentage < 50) {
-		icon_name = g_strdup_printf ("battery-medium%s", bat_state);
-	} else if (percentage >= 10 && percentage < 25) {
-		icon_name = g_strdup_printf ("battery-low%s", bat_state);
+		level = 0;
+	} else if (percentage >= 50) {
+		level = 1;
+	} else if (percentage >= 25) {
+		level = 2;
+	} else if (percentage >= 10) {
+		level = 3;
 	} else {
-		icon_name = g_strdup_printf ("battery-caution%s", bat_state);
+		level = 4;
 	}
 
-	return icon_name;
+	return battery_icon_names[level][bat_state];
 }
 
 static void
@@ -1416,15 +2112,19 @@ on_power_device_changed_cb (UpDevice *device, GParamSpec *pspec, gpointer user_d
 {
 	GtkImage *bat_tray = GTK_IMAGE (user_data);
 
-	gchar *icon_name;
+	const gchar *icon_name, *current = NULL;
 	gdouble percentage;
+	gboolean is_present;
 	UpDeviceState state;
 
 	g_object_get (device,
                   "state", &state,
                   "percentage", &percentage,
+                  "is-present", &is_present,
                   NULL);
 
+	gtk_widget_set_visible (GTK_WIDGET (bat_tray), is_present);
+
 /* Sometimes the reported state is fully charged but battery is at 99%,
  * refusing to reach 100%. In these cases, just assume 100%.
  */
@@ -1434,13 +2134,12 @@ on_power_device_changed_cb (UpDevice *device, GParamSpec *pspec, gpointer user_d
 
 	icon_name = get_battery_icon_name (percentage, state);
 
-	gtk_image_set_from_icon_name (bat_tray,
-                                  icon_name,
-                                  GTK_ICON_SIZE_BUTTON);
-
-	gtk_image_set_pixel_size (bat_tray, 22);
-
-	g_free (icon_name);
+	/* Most property changes keep the icon in the same bucket */
+	current = g_object_get_data (G_OBJECT (bat_tray), "icon-name");
+	if (g_strcmp0 (current, icon_name) != 0) {
+		greeter_image_set_icon_name (bat_tray, icon_name, GTK_ICON_SIZE_BUTTON);
+		g_object_set_data (G_OBJECT (bat_tray), "icon-name", (gpointer) icon_name);
+	}
 }
 
 static void
@@ -1453,14 +2152,23 @@ updevice_added_cb (UpDevice *device, GreeterWindow *window)
 	g_object_get (device, "is-present", &is_present, NULL);
 
 	if (device_type == UP_DEVICE_KIND_BATTERY && is_present) {
-		GtkWidget *image = gtk_image_new_from_icon_name ("battery-full-symbolic", GTK_ICON_SIZE_BUTTON);
+		GtkWidget *image = gtk_image_new ();
+		greeter_image_set_icon_name (GTK_IMAGE (image), "battery-full-symbolic", GTK_ICON_SIZE_BUTTON);
+		gtk_image_set_pixel_size (GTK_IMAGE (image), 22);
 		gtk_box_pack_start (GTK_BOX (window->priv->indicator_box), image, FALSE, FALSE, 0);
 		gtk_widget_show (image);
 
-		g_object_set_data (G_OBJECT (image), "updevice", device);
+		g_hash_table_insert (window->priv->battery_devices, device, image);
 
 		on_power_device_changed_cb (device, NULL, image);
-		g_signal_connect (device, "notify", G_CALLBACK (on_power_device_changed_cb), image);
+
+		/* Energy, voltage, rate etc. do not affect the icon */
+		g_signal_connect_object (device, "notify::percentage",
+                                 G_CALLBACK (on_power_device_changed_cb), image, 0);
+		g_signal_connect_object (device, "notify::state",
+                                 G_CALLBACK (on_power_device_changed_cb), image, 0);
+		g_signal_connect_object (device, "notify::is-present",
+                                 G_CALLBACK (on_power_device_changed_cb), image, 0);
 	}
 }
 
@@ -1477,34 +2185,72 @@ up_client_device_removed_cb (UpClient *upclient,
                              UpDevice *removed_device,
                              gpointer  user_data)
 {
-	GList *children, *l;
+	GtkWidget *image;
 	GreeterWindow *window = GREETER_WINDOW (user_data);
 
 	if (!removed_device)
 		return;
 
-	children = gtk_container_get_children (GTK_CONTAINER (window->priv->indicator_box));
+	image = g_hash_table_lookup (window->priv->battery_devices, removed_device);
+	if (!image)
+		return;
 
-	for (l = children; l; l = l->next) {
-		GtkWidget *child = GTK_WIDGET (l->data);
-		UpDevice *device = (UpDevice*)g_object_get_data (G_OBJECT (child), "updevice");
+	g_hash_table_remove (window->priv->battery_devices, removed_device);
+	gtk_widget_destroy (image);
+}
 
-		if (device && removed_device && device == removed_device) {
-			gtk_container_remove (GTK_CONTAINER (window->priv->indicator_box), child);
-			gtk_widget_destroy (child);
-			break;
-		}
+static void
+up_client_data_free (UpClientData *data)
+{
+	g_clear_pointer (&data->devices, g_ptr_array_unref);
+	g_clear_object (&data->client);
+	g_free (data);
+}
+
+/* up_client_new() and up_client_get_devices2() block on UPower */
+static void
+up_client_new_thread (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+	UpClientData *data;
+
+	data = g_new0 (UpClientData, 1);
+	data->client = up_client_new ();
+	if (!data->client) {
+		up_client_data_free (data);
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to connect to UPower");
+		return;
 	}
+
+	data->devices = up_client_get_devices2 (data->client);
+
+	g_task_return_pointer (task, data, (GDestroyNotify) up_client_data_free);
 }
 
 static void
-load_battery_indicator (GreeterWindow *window)
+up_client_new_cb (GObject      *source,
+                  GAsyncResult *res,
+                  gpointer      user_data)
 {
 	guint i;
+	UpClientData *data;
+	GError *error = NULL;
+	GreeterWindow *window = GREETER_WINDOW (source);
 	GreeterWindowPrivate *priv = window->priv;
 
-	priv->up_client = up_client_new ();
-	priv->devices = up_client_get_devices2 (priv->up_client);
+	data = g_task_propagate_pointer (G_TASK (res), &error);
+	if (!data) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("%s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	priv->up_client = g_steal_pointer (&data->client);
+	priv->devices = g_steal_pointer (&data->devices);
+	up_client_data_free (data);
 
 	if (priv->devices) {
 		for (i = 0; i < priv->devices->len; i++) {
@@ -1519,6 +2265,19 @@ load_battery_indicator (GreeterWindow *window)
                       G_CALLBACK (up_client_device_removed_cb), window);
 }
 
+static void
+load_battery_indicator (GreeterWindow *window)
+{
+	GTask *task;
+	GreeterWindowPrivate *priv = window->priv;
+
+	priv->up_cancellable = g_cancellable_new ();
+
+	task = g_task_new (window, priv->up_cancellable, up_client_new_cb, NULL);
+	g_task_run_in_thread (task, up_client_new_thread);
+	g_object_unref (task);
+}
+
 static void
 menu_size_allocate_cb (GtkWidget     *widget,
                        GtkAllocation *allocation,
@@ -1530,87 +2289,146 @@ menu_size_allocate_cb (GtkWidget     *widget,
 static void
 on_menu_item_activated (GtkMenuItem *item, gpointer user_data)
 {
-	gboolean active;
-	GdkMonitor *monitor;
-	GdkRectangle geometry;
+	GdkRectangle *geometry;
 	GreeterWindow *window = GREETER_WINDOW (user_data);
 
-	monitor = (GdkMonitor *)g_object_get_data (G_OBJECT (item), "monitor");
-	gdk_monitor_get_geometry (monitor, &geometry);
+	if (!gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (item)))
+		return;
+
+	geometry = g_object_get_data (G_OBJECT (item), "geometry");
 
-	active = gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (item));
-	if (active) {
-		gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (item), TRUE);
+	g_signal_emit (G_OBJECT (window), signals[POSITION_CHANGED], 0, geometry);
+}
 
-		g_signal_emit (G_OBJECT (window), signals[POSITION_CHANGED], 0, &geometry);
+/* Check the item of the active monitor without emitting position-changed */
+static void
+switch_menu_sync_active (GreeterWindow *window)
+{
+	GList *items, *l;
+	GreeterWindowPrivate *priv = window->priv;
+
+	items = gtk_container_get_children (GTK_CONTAINER (priv->switch_menu));
+	for (l = items; l; l = l->next) {
+		GdkRectangle *geometry = g_object_get_data (G_OBJECT (l->data), "geometry");
+
+		if (gdk_rectangle_equal (geometry, &priv->active_geometry)) {
+			g_signal_handlers_block_by_func (l->data, on_menu_item_activated, window);
+			gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (l->data), TRUE);
+			g_signal_handlers_unblock_by_func (l->data, on_menu_item_activated, window);
+			break;
+		}
 	}
+	g_list_free (items);
+}
+
+static gboolean
+switch_menu_free_idle_cb (gpointer user_data)
+{
+	GreeterWindowPrivate *priv = GREETER_WINDOW (user_data)->priv;
+
+	priv->switch_menu_free_id = 0;
+
+	if (priv->switch_menu)
+		gtk_widget_destroy (priv->switch_menu);
+
+	return G_SOURCE_REMOVE;
 }
 
+/* In low-memory mode the menu is built on each click and freed once closed.
+ * The item is activated after "deactivate", so it is freed from an idle. */
 static void
-switch_indicator_button_clicked_cb (GtkButton *button,
-                                    gpointer   user_data)
+switch_menu_deactivate_cb (GtkMenuShell *menu,
+                           gpointer      user_data)
 {
+	GreeterWindowPrivate *priv = GREETER_WINDOW (user_data)->priv;
+
+	if (!priv->switch_menu_free_id)
+		priv->switch_menu_free_id = g_idle_add (switch_menu_free_idle_cb, user_data);
+}
+
+static void
+switch_menu_build (GreeterWindow *window)
+{
+	gint m;
 	GSList *group = NULL;
-	GdkDisplay *display;
-	GdkRectangle geometry;
-	gint m, monitors = 0;
-	gint x, y, width, height;
-	GtkWidget *toplevel, *menu, *menuitem;
-	cairo_region_t *region;
-	GreeterWindow *window = GREETER_WINDOW (user_data);
+	const GreeterTopology *snapshot;
+	GreeterWindowPrivate *priv = window->priv;
 
-	region = cairo_region_create ();
-	display = gdk_display_get_default ();
-	monitors = gdk_display_get_n_monitors (display);
-	toplevel = gtk_widget_get_toplevel (GTK_WIDGET (window));
+	if (priv->switch_menu)
+		gtk_widget_destroy (priv->switch_menu);
+
+	snapshot = greeter_monitor_topology_get_snapshot (greeter_monitor_topology_get_default ());
+	priv->switch_menu_serial = snapshot->serial;
 
-	gtk_widget_get_size_request (GTK_WIDGET (toplevel), &width, &height);
-	gdk_window_get_origin (gtk_widget_get_window (GTK_WIDGET (toplevel)), &x, &y);
+	priv->switch_menu = gtk_menu_new ();
+	gtk_menu_attach_to_widget (GTK_MENU (priv->switch_menu), priv->switch_indicator, NULL);
+	g_signal_connect (G_OBJECT (priv->switch_menu), "size-allocate",
+                      G_CALLBACK (menu_size_allocate_cb), NULL);
+	g_signal_connect (G_OBJECT (priv->switch_menu), "destroy",
+                      G_CALLBACK (gtk_widget_destroyed), &priv->switch_menu);
 
-	menu = gtk_menu_new ();
+	if (greeter_memory_is_low ())
+		g_signal_connect (G_OBJECT (priv->switch_menu), "deactivate",
+                          G_CALLBACK (switch_menu_deactivate_cb), window);
 
-	for (m = 0; m < monitors; m++) {
-		GdkMonitor *monitor;
+	for (m = 0; m < snapshot->n_outputs; m++) {
+		GtkWidget *menuitem;
+		GdkRectangle *geometry;
 		gchar *print_name = NULL;
-		const gchar *name, *monitor_name;
-
-		monitor = gdk_display_get_monitor (display, m);
-		gdk_monitor_get_geometry (monitor, &geometry);
-		name = gdk_monitor_get_model (monitor);
+		const gchar *monitor_name;
+		const GreeterOutput *output = &snapshot->outputs[m];
 
-		if (cairo_region_contains_rectangle (region, &geometry) == CAIRO_REGION_OVERLAP_IN)
+		if (output->mirror_of >= 0)
 			continue;
 
-		cairo_region_union_rectangle (region, &geometry);
-		monitor_name = name ? name : "<unknown>";
+		geometry = g_memdup (&output->geometry, sizeof (GdkRectangle));
+		monitor_name = output->model ? output->model : "<unknown>";
 
 		print_name = g_strdup_printf ("%d.   %s (%d X %d)", m+1, monitor_name,
-                                      geometry.width, geometry.height);
+                                      geometry->width, geometry->height);
 
 		menuitem = gtk_radio_menu_item_new_with_label (group, print_name);
 		group = gtk_radio_menu_item_get_group (GTK_RADIO_MENU_ITEM (menuitem));
-		g_object_set_data (G_OBJECT (menuitem), "monitor", monitor);
-		gtk_menu_shell_append (GTK_MENU_SHELL (menu), menuitem);
+		g_object_set_data_full (G_OBJECT (menuitem), "geometry", geometry, g_free);
+		gtk_menu_shell_append (GTK_MENU_SHELL (priv->switch_menu), menuitem);
 		gtk_widget_show_all (menuitem);
 
-		if (x == geometry.x && y == geometry.y &&
-            width == geometry.width && height == geometry.height) {
-			gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (menuitem), TRUE);
-		}
-
 		g_signal_connect (menuitem, "activate", G_CALLBACK (on_menu_item_activated), window);
 
 		g_clear_pointer (&print_name, g_free);
 	}
 
-	gtk_menu_popup_at_widget (GTK_MENU (menu),
+	switch_menu_sync_active (window);
+}
+
+static void
+switch_indicator_topology_changed_cb (GreeterMonitorTopology *topology,
+                                      const GreeterTopology  *snapshot,
+                                      gpointer                user_data)
+{
+	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
+
+	/* Rebuilt on the next click */
+	if (priv->switch_menu && snapshot->serial != priv->switch_menu_serial)
+		gtk_widget_destroy (priv->switch_menu);
+}
+
+static void
+switch_indicator_button_clicked_cb (GtkButton *button,
+                                    gpointer   user_data)
+{
+	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
+
+	if (!priv->switch_menu)
+		switch_menu_build (window);
+
+	gtk_menu_popup_at_widget (GTK_MENU (priv->switch_menu),
                               GTK_WIDGET (button),
                               GDK_GRAVITY_NORTH_WEST,
                               GDK_GRAVITY_SOUTH_WEST,
-                              gtk_get_current_event ());
-
-	g_signal_connect (G_OBJECT (menu), "size-allocate",
-                      G_CALLBACK (menu_size_allocate_cb), NULL);
+                              NULL);
 }
 
 static void
@@ -1626,7 +2444,8 @@ load_switch_greeter_window_indicator (GreeterWindow *window)
 	gtk_button_set_relief (GTK_BUTTON (priv->switch_indicator), GTK_RELIEF_NONE);
 	gtk_widget_set_focus_on_click (GTK_WIDGET (priv->switch_indicator), FALSE);
 
-	icon = gtk_image_new_from_icon_name ("view-paged-symbolic", GTK_ICON_SIZE_BUTTON);
+	icon = gtk_image_new ();
+	greeter_image_set_icon_name (GTK_IMAGE (icon), "view-paged-symbolic", GTK_ICON_SIZE_BUTTON);
 	gtk_container_add (GTK_CONTAINER (priv->switch_indicator), icon);
 
 	gtk_box_pack_start (GTK_BOX (priv->indicator_box), priv->switch_indicator, FALSE, FALSE, 0);
@@ -1636,6 +2455,8 @@ load_switch_greeter_window_indicator (GreeterWindow *window)
 
 	g_signal_connect (G_OBJECT (priv->switch_indicator), "clicked",
                       G_CALLBACK (switch_indicator_button_clicked_cb), window);
+	g_signal_connect_object (greeter_monitor_topology_get_default (), "changed",
+                             G_CALLBACK (switch_indicator_topology_changed_cb), window, 0);
 
 	gtk_widget_show_all (priv->switch_indicator);
 }
@@ -1670,52 +2491,109 @@ translate_time_format_string (const char *str)
 	return res;
 }
 
-/* Clock */
+/* Whether @format shows seconds, i.e. needs a wakeup every second */
 static gboolean
-clock_timeout_thread (gpointer data)
+time_format_has_seconds (const gchar *format)
 {
-	GtkLabel *clock_label = GTK_LABEL (data);
+	const gchar *p;
 
-	GDateTime *dt = NULL;
+	for (p = strchr (format, '%'); p; p = strchr (p, '%')) {
+		p++;
+		while (*p && strchr ("-_0^#", *p))
+			p++;
+		if (*p && strchr ("STrXsc", *p))
+			return TRUE;
+		if (*p)
+			p++;
+	}
+
+	return FALSE;
+}
+
+/* Clock */
+static void
+clock_update (GreeterWindow *window)
+{
+	gchar *text;
+	GDateTime *dt;
+	GreeterWindowPrivate *priv = window->priv;
 
 	dt = g_date_time_new_now_local ();
-	if (dt) {
-		gchar *fm = g_date_time_format (dt, translate_time_format_string (N_("%B %-d %Y  %l:%M %p")));
-		gchar *markup = g_markup_printf_escaped ("<b><span foreground=\"white\">%s</span></b>", fm);
-		gtk_label_set_markup (GTK_LABEL (clock_label), markup);
-		g_free (fm);
+	if (!dt)
+		return;
+
+	text = g_date_time_format (dt, priv->clock_format);
+	g_date_time_unref (dt);
+
+	/* Only relayout when the rendered text actually changes */
+	if (text && g_strcmp0 (text, priv->clock_text) != 0) {
+		gchar *markup = g_markup_printf_escaped ("<b><span foreground=\"white\">%s</span></b>", text);
+		gtk_label_set_markup (GTK_LABEL (priv->clock_label), markup);
 		g_free (markup);
 
-		g_date_time_unref (dt);
+		g_free (priv->clock_text);
+		priv->clock_text = text;
+	} else {
+		g_free (text);
 	}
+}
 
-	return TRUE;
+static gboolean clock_timeout_cb (gpointer user_data);
+
+/* Wake up right after the next minute (or second) boundary */
+static void
+clock_schedule (GreeterWindow *window)
+{
+	gint64 now, period, delay;
+	GreeterWindowPrivate *priv = window->priv;
+
+	now = g_get_real_time ();
+	period = priv->clock_seconds ? G_USEC_PER_SEC : 60 * G_USEC_PER_SEC;
+	delay = period - (now % period);
+
+	priv->clock_timeout_id = g_timeout_add (delay / 1000 + 1, clock_timeout_cb, window);
+}
+
+static gboolean
+clock_timeout_cb (gpointer user_data)
+{
+	GreeterWindow *window = GREETER_WINDOW (user_data);
+
+	clock_update (window);
+	clock_schedule (window);
+
+	return FALSE;
 }
 
 static void
 load_clock_indicator (GreeterWindow *window)
 {
 	GtkStyleContext *style;
-	GtkWidget *clock_label;
 	GreeterWindowPrivate *priv = window->priv;
 
-	clock_label = gtk_label_new ("");
-	style = gtk_widget_get_style_context (GTK_WIDGET (clock_label));
+	priv->clock_label = gtk_label_new ("");
+	style = gtk_widget_get_style_context (GTK_WIDGET (priv->clock_label));
 	gtk_style_context_add_class (style, "clock-label");
-	gtk_box_pack_start (GTK_BOX (priv->indicator_box), clock_label, FALSE, FALSE, 0);
-	gtk_widget_show_all (clock_label);
+	gtk_box_pack_start (GTK_BOX (priv->indicator_box), priv->clock_label, FALSE, FALSE, 0);
+	gtk_widget_show_all (priv->clock_label);
+
+	/* The translated format does not change while the greeter runs */
+	priv->clock_format = g_strdup (translate_time_format_string (N_("%B %-d %Y  %l:%M %p")));
+	priv->clock_seconds = time_format_has_seconds (priv->clock_format);
 
 	/* update clock */
-	clock_timeout_thread (clock_label);
-	gdk_threads_add_timeout (1000, (GSourceFunc) clock_timeout_thread, clock_label);
+	clock_update (window);
+	clock_schedule (window);
 }
 
 static void
 network_indicator_application_start (void)
 {
-	const gchar *cmd;
+	const gchar *cmd, *phase;
 	gchar **argv = NULL, **envp = NULL;
 
+	phase = greeter_watchdog_enter ("nm-applet-settings");
+
 	cmd = "/usr/bin/gsettings set org.gnome.nm-applet disable-connected-notifications true";
 	g_spawn_command_line_sync (cmd, NULL, NULL, NULL, NULL);
 
@@ -1725,6 +2603,8 @@ network_indicator_application_start (void)
 	cmd = "/usr/bin/gsettings set org.gnome.nm-applet suppress-wireless-networks-available true";
 	g_spawn_command_line_sync (cmd, NULL, NULL, NULL, NULL);
 
+	greeter_watchdog_leave (phase);
+
 	cmd = "nm-applet --indicator";
 	g_shell_parse_argv (cmd, NULL, &argv, NULL);
 
@@ -1771,64 +2651,478 @@ load_indicators (GreeterWindow *window)
 	other_indicator_application_start ();
 }
 
+/* Reads Agent.conf line by line until the CLEAN_MODE entry */
+static void
+agent_conf_read_thread (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+	GFile *file;
+	gchar *line;
+	GFileInputStream *stream;
+	GDataInputStream *data;
+	gboolean cm_enable = TRUE;
+
+	file = g_file_new_for_path (AGENT_CONF);
+	stream = g_file_read (file, cancellable, NULL);
+	g_object_unref (file);
+
+	if (!stream) {
+		g_task_return_boolean (task, cm_enable);
+		return;
+	}
+
+	data = g_data_input_stream_new (G_INPUT_STREAM (stream));
+	while ((line = g_data_input_stream_read_line (data, NULL, cancellable, NULL)) != NULL) {
+		gboolean found = g_str_has_prefix (line, "CLEAN_MODE");
+
+		if (found) {
+			gchar *value = strchr (line, '=');
+			if (value && g_strcmp0 (g_strstrip (value + 1), "disable") == 0)
+				cm_enable = FALSE;
+		}
+		g_free (line);
+
+		if (found)
+			break;
+	}
+
+	g_object_unref (data);
+	g_object_unref (stream);
+
+	g_task_return_boolean (task, cm_enable);
+}
+
+static void
+agent_conf_read_cb (GObject      *source,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+	GError *error = NULL;
+	gboolean cm_enable;
+	GreeterWindow *window = GREETER_WINDOW (source);
+
+	cm_enable = g_task_propagate_boolean (G_TASK (res), &error);
+	if (error) {
+		g_error_free (error);
+		return;
+	}
+
+	window->priv->cleanmode_allowed = cm_enable;
+	clean_mode_sw_update_sensitive (window);
+}
+
+static void
+agent_conf_load (GreeterWindow *window)
+{
+	GTask *task;
+
+	task = g_task_new (window, window->priv->cleanmode_cancellable, agent_conf_read_cb, NULL);
+	g_task_run_in_thread (task, agent_conf_read_thread);
+	g_object_unref (task);
+}
+
+static void
+agent_conf_changed_cb (GFileMonitor      *monitor,
+                       GFile             *file,
+                       GFile             *other_file,
+                       GFileMonitorEvent  event_type,
+                       gpointer           user_data)
+{
+	switch (event_type) {
+		case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+		case G_FILE_MONITOR_EVENT_CREATED:
+		case G_FILE_MONITOR_EVENT_DELETED:
+			agent_conf_load (GREETER_WINDOW (user_data));
+			break;
+		default:
+			break;
+	}
+}
+
 static void
 clean_mode_sw_set_sensitive (GreeterWindow *window)
 {
+	GFile *file;
 	GreeterWindowPrivate *priv = window->priv;
-	gchar *contents = NULL;
-	gboolean cm_enable = TRUE;
-	int i;
 
 	if (!g_file_test (PAM_CLEAN_AUTH, G_FILE_TEST_EXISTS)){
 		gtk_widget_hide (GTK_WIDGET (priv->cm_box));
 		return;
 	}
 
-	g_file_get_contents (AGENT_CONF, &contents, NULL, NULL);
+	priv->cleanmode_cancellable = g_cancellable_new ();
 
-	if (contents) {
-		gchar **lines = g_strsplit (contents, "\n" , -1);
-		for (i = 0; lines[i] != NULL; i++) {
-			if (g_str_has_prefix (lines[i], "CLEAN_MODE")) {
-				gchar **tokens = g_strsplit (lines[i], "=", -1);
-				if (tokens[1]) {
-					g_strstrip (tokens[1]);
-					if (g_strcmp0 (tokens[1], "disable") == 0) {
-						cm_enable = FALSE;
-					}
-				}
-				g_strfreev (tokens);
-				break;
-			}
+	/* The agent may change its configuration while the greeter is running */
+	file = g_file_new_for_path (AGENT_CONF);
+	priv->agent_conf_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+	g_object_unref (file);
+
+	if (priv->agent_conf_monitor)
+		g_signal_connect (priv->agent_conf_monitor, "changed",
+                          G_CALLBACK (agent_conf_changed_cb), window);
+
+	agent_conf_load (window);
+}
+
+static GtkWidget *
+get_power_button (GreeterWindow *window, gint type)
+{
+	GreeterWindowPrivate *priv = window->priv;
+
+	switch (type)
+	{
+		case SYSTEM_SHUTDOWN:
+			return priv->btn_shutdown;
+		case SYSTEM_RESTART:
+			return priv->btn_restart;
+		case SYSTEM_SUSPEND:
+			return priv->btn_suspend;
+		case SYSTEM_HIBERNATE:
+			return priv->btn_hibernate;
+		default:
+			g_return_val_if_reached (NULL);
+	}
+}
+
+static void
+power_capability_update (GreeterWindow *window, gint type, gboolean can)
+{
+	window->priv->can_power[type] = can;
+
+	gtk_widget_set_visible (get_power_button (window, type), can);
+}
+
+static void
+logind_can_cb (GObject      *source,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+	GVariant *result;
+	GError *error = NULL;
+	gboolean can = FALSE;
+	PowerQuery *query = user_data;
+
+	result = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		g_free (query);
+		return;
+	}
+
+	if (result) {
+		const gchar *answer;
+		g_variant_get (result, "(&s)", &answer);
+		can = (g_strcmp0 (answer, "yes") == 0);
+		g_variant_unref (result);
+	} else {
+		g_warning ("Failed to query %s: %s", power_query_methods[query->type], error->message);
+		g_clear_error (&error);
+	}
+
+	power_capability_update (query->window, query->type, can);
+
+	g_free (query);
+}
+
+static void
+power_capabilities_probe (GreeterWindow *window)
+{
+	gint type;
+	GreeterWindowPrivate *priv = window->priv;
+
+	/* All queries are sent at once, buttons show up as the answers arrive */
+	for (type = 0; type < SYSTEM_LAST; type++) {
+		PowerQuery *query = g_new0 (PowerQuery, 1);
+		query->window = window;
+		query->type = type;
+
+		g_dbus_proxy_call (priv->login1_proxy,
+                           power_query_methods[type],
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           priv->power_cancellable,
+                           logind_can_cb,
+                           query);
+	}
+}
+
+/* Idle hints and the like change all the time, skip those */
+static void
+login1_properties_changed_cb (GDBusProxy *proxy,
+                              GVariant   *changed_properties,
+                              GStrv       invalidated_properties,
+                              gpointer    user_data)
+{
+	gint i;
+
+	for (i = 0; power_query_properties[i]; i++) {
+		if (g_variant_lookup (changed_properties, power_query_properties[i], "*", NULL) ||
+            (invalidated_properties &&
+             g_strv_contains ((const gchar * const *) invalidated_properties, power_query_properties[i]))) {
+			power_capabilities_probe (GREETER_WINDOW (user_data));
+			return;
 		}
-		g_strfreev (lines);
 	}
+}
 
-	if (!cm_enable) {
-		gtk_widget_set_sensitive (GTK_WIDGET (priv->cleanmode_switch), FALSE);
+/* The clock timeout counts on the monotonic clock, which stands still
+ * while suspended: resync as soon as the system is back */
+static void
+login1_signal_cb (GDBusProxy  *proxy,
+                  const gchar *sender_name,
+                  const gchar *signal_name,
+                  GVariant    *parameters,
+                  gpointer     user_data)
+{
+	gboolean sleeping;
+	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
+
+	if (g_strcmp0 (signal_name, "PrepareForSleep") != 0 ||
+        !g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)")))
+		return;
+
+	g_variant_get (parameters, "(b)", &sleeping);
+	if (sleeping || !priv->clock_label)
+		return;
+
+	g_clear_handle_id (&priv->clock_timeout_id, g_source_remove);
+	clock_update (window);
+	clock_schedule (window);
+}
+
+/* Without logind, fall back to liblightdm (ConsoleKit) in a worker thread */
+static void
+lightdm_power_probe_thread (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+	gboolean *caps = g_new0 (gboolean, SYSTEM_LAST);
+
+	caps[SYSTEM_SHUTDOWN] = lightdm_get_can_shutdown ();
+	caps[SYSTEM_RESTART] = lightdm_get_can_restart ();
+	caps[SYSTEM_SUSPEND] = lightdm_get_can_suspend ();
+	caps[SYSTEM_HIBERNATE] = lightdm_get_can_hibernate ();
+
+	g_task_return_pointer (task, caps, g_free);
+}
+
+static void
+lightdm_power_probe_cb (GObject      *source,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+	gint type;
+	gboolean *caps;
+
+	caps = g_task_propagate_pointer (G_TASK (res), NULL);
+	if (!caps)
+		return;
+
+	for (type = 0; type < SYSTEM_LAST; type++)
+		power_capability_update (GREETER_WINDOW (source), type, caps[type]);
+
+	g_free (caps);
+}
+
+static void
+login1_proxy_ready_cb (GObject      *source,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+	GDBusProxy *proxy;
+	GError *error = NULL;
+	GreeterWindow *window;
+	GreeterWindowPrivate *priv;
+
+	proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
 	}
+	g_clear_error (&error);
+
+	window = GREETER_WINDOW (user_data);
+	priv = window->priv;
+
+	if (proxy && g_dbus_proxy_get_name_owner (proxy)) {
+		priv->login1_proxy = proxy;
+		g_signal_connect (priv->login1_proxy, "g-properties-changed",
+                          G_CALLBACK (login1_properties_changed_cb), window);
+		g_signal_connect (priv->login1_proxy, "g-signal",
+                          G_CALLBACK (login1_signal_cb), window);
+		power_capabilities_probe (window);
+	} else {
+		GTask *task;
 
-	g_free (contents);
+		g_clear_object (&proxy);
+
+		task = g_task_new (window, priv->power_cancellable, lightdm_power_probe_cb, NULL);
+		g_task_run_in_thread (task, lightdm_power_probe_thread);
+		g_object_unref (task);
+	}
 }
 
 static void
-show_command_dialog (GtkWidget *parent,
-                     const gchar* icon,
-                     const gchar* title,
-                     const gchar* message,
-                     int          type)
+power_capabilities_probe_after_paint_cb (GdkFrameClock *clock, gpointer user_data)
+{
+	GreeterWindow *window = GREETER_WINDOW (user_data);
+	GreeterWindowPrivate *priv = window->priv;
+
+	if (clock)
+		g_signal_handlers_disconnect_by_func (clock, power_capabilities_probe_after_paint_cb, user_data);
+
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                              G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+                              NULL,
+                              "org.freedesktop.login1",
+                              "/org/freedesktop/login1",
+                              "org.freedesktop.login1.Manager",
+                              priv->power_cancellable,
+                              login1_proxy_ready_cb,
+                              window);
+}
+
+/* The probe starts once the frame that first drew the login form is done,
+ * so its D-Bus traffic stays out of the way of the first paint */
+static gboolean
+power_capabilities_probe_draw_cb (GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+	GdkFrameClock *clock;
+
+	g_signal_handlers_disconnect_by_func (widget, power_capabilities_probe_draw_cb, user_data);
+
+	clock = gtk_widget_get_frame_clock (widget);
+	if (clock)
+		g_signal_connect_object (clock, "after-paint",
+                                 G_CALLBACK (power_capabilities_probe_after_paint_cb), widget, 0);
+	else
+		power_capabilities_probe_after_paint_cb (NULL, widget);
+
+	return FALSE;
+}
+
+static void
+logind_action_cb (GObject      *source,
+                  GAsyncResult *res,
+                  gpointer      user_data)
 {
-	GList *items, *l = NULL;
-	gint res, logged_in_users = 0;
+	GVariant *result;
+	GError *error = NULL;
+
+	result = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (result) {
+		g_variant_unref (result);
+	} else {
+		g_warning ("Failed to run power action: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+static void
+lightdm_power_action_thread (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+	GError *error = NULL;
+
+	switch (GPOINTER_TO_INT (task_data))
+	{
+		case SYSTEM_SHUTDOWN:
+			lightdm_shutdown (&error);
+			break;
+
+		case SYSTEM_RESTART:
+			lightdm_restart (&error);
+			break;
+
+		case SYSTEM_SUSPEND:
+			lightdm_suspend (&error);
+			break;
+
+		case SYSTEM_HIBERNATE:
+			lightdm_hibernate (&error);
+			break;
+
+		default:
+			break;
+	}
+
+	if (error) {
+		g_warning ("Failed to run power action: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_task_return_boolean (task, TRUE);
+}
+
+/* Dispatch the action without blocking the UI on a slow logind */
+static void
+power_action_run (GreeterWindow *window, gint type)
+{
+	GreeterWindowPrivate *priv = window->priv;
+
+	g_return_if_fail (type >= 0 && type < SYSTEM_LAST);
+
+	if (priv->login1_proxy) {
+		g_dbus_proxy_call (priv->login1_proxy,
+                           power_action_methods[type],
+                           g_variant_new ("(b)", FALSE),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           NULL,
+                           logind_action_cb,
+                           NULL);
+	} else {
+		GTask *task = g_task_new (NULL, NULL, NULL, NULL);
+		g_task_set_task_data (task, GINT_TO_POINTER (type), NULL);
+		g_task_run_in_thread (task, lightdm_power_action_thread);
+		g_object_unref (task);
+	}
+}
+
+typedef struct
+{
+	const gchar *icon;
+	const gchar *title;
+	const gchar *message;
+	gint         type;
+} CommandDialog;
+
+static void
+logged_in_users_thread (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+	g_task_return_int (task, get_logged_in_users (cancellable));
+}
+
+static void
+logged_in_users_cb (GObject      *source,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+	gint res_id, logged_in_users;
 	gchar *new_message = NULL;
-	GtkWidget *dialog, *toplevel;
+	GtkWidget *dialog;
+	GError *error = NULL;
+	CommandDialog *command;
+	GreeterWindow *window = GREETER_WINDOW (source);
 
-	items = lightdm_user_list_get_users (lightdm_user_list_get_instance ());
-	for (l = items; l; l = l->next) {
-		LightDMUser *user = l->data;
-		if (lightdm_user_get_logged_in (user))
-			logged_in_users++;
+	logged_in_users = g_task_propagate_int (G_TASK (res), &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
 	}
+	g_clear_error (&error);
+
+	command = g_task_get_task_data (G_TASK (res));
 
 	/* Check if there are still users logged in, count them and if so, display a warning */
 	if (logged_in_users > 0) {
@@ -1836,18 +3130,13 @@ show_command_dialog (GtkWidget *parent,
                                           "Warning: There are still %d users logged in.",
                                           logged_in_users), logged_in_users);
 
-		new_message = g_strdup_printf ("%s\n%s", warning, message);
+		new_message = g_strdup_printf ("%s\n%s", warning, command->message);
 		g_free (warning);
 	} else {
-		new_message = g_strdup (message);
+		new_message = g_strdup (command->message);
 	}
 
-	toplevel = gtk_widget_get_toplevel (parent);
-
-	dialog = greeter_message_dialog_new (GTK_WINDOW (toplevel),
-                                         icon,
-                                         title,
-                                         new_message);
+	dialog = message_dialog_acquire (window, command->icon, command->title, new_message);
 
 	gtk_dialog_add_buttons (GTK_DIALOG (dialog),
                             _("Ok"), GTK_RESPONSE_OK,
@@ -1856,35 +3145,46 @@ show_command_dialog (GtkWidget *parent,
 	gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_CANCEL);
 
 	gtk_widget_show (dialog);
-	res = gtk_dialog_run (GTK_DIALOG (dialog));
-	gtk_widget_destroy (dialog);
+	res_id = gtk_dialog_run (GTK_DIALOG (dialog));
+	message_dialog_release (window, dialog);
 
 	g_free (new_message);
 
-	if (res != GTK_RESPONSE_OK)
-		return;
-
-	switch (type)
-	{
-		case SYSTEM_SHUTDOWN:
-			lightdm_shutdown (NULL);
-			break;
+	window->priv->command_pending = FALSE;
 
-		case SYSTEM_RESTART:
-			lightdm_restart (NULL);
-			break;
+	if (res_id != GTK_RESPONSE_OK)
+		return;
 
-		case SYSTEM_SUSPEND:
-			lightdm_suspend (NULL);
-			break;
+	power_action_run (window, command->type);
+}
 
-		case SYSTEM_HIBERNATE:
-			lightdm_hibernate (NULL);
-			break;
+/* The logged in users are counted off the UI thread, the dialog is shown
+ * once the count arrives */
+static void
+show_command_dialog (GreeterWindow *window,
+                     const gchar* icon,
+                     const gchar* title,
+                     const gchar* message,
+                     int          type)
+{
+	GTask *task;
+	CommandDialog *command;
+	GreeterWindowPrivate *priv = window->priv;
 
-		default:
-			return;
-	}
+	if (priv->command_pending)
+		return;
+	priv->command_pending = TRUE;
+
+	command = g_new0 (CommandDialog, 1);
+	command->icon = icon;
+	command->title = title;
+	command->message = message;
+	command->type = type;
+
+	task = g_task_new (window, priv->power_cancellable, logged_in_users_cb, NULL);
+	g_task_set_task_data (task, command, g_free);
+	g_task_run_in_thread (task, logged_in_users_thread);
+	g_object_unref (task);
 }
 
 static void
@@ -1897,7 +3197,7 @@ shutdown_button_clicked_cb (GtkButton *button, gpointer user_data)
 	title = _("System Shutdown");
 	msg = _("Are you sure you want to close all programs and shut down the computer?");
 
-	show_command_dialog (GTK_WIDGET (window), img, title, msg, SYSTEM_SHUTDOWN);
+	show_command_dialog (window, img, title, msg, SYSTEM_SHUTDOWN);
 }
 
 static void
@@ -1910,7 +3210,7 @@ restart_button_clicked_cb (GtkButton *button, gpointer user_data)
 	title = _("System Restart");
 	msg = _("Are you sure you want to close all programs and restart the computer?");
 
-	show_command_dialog (GTK_WIDGET (window), img, title, msg, SYSTEM_RESTART);
+	show_command_dialog (window, img, title, msg, SYSTEM_RESTART);
 }
 
 static void
@@ -1923,7 +3223,7 @@ suspend_button_clicked_cb (GtkButton *button, gpointer user_data)
 	title = _("System Suspend");
 	msg = _("Are you sure you want to suspend the computer?");
 
-	show_command_dialog (GTK_WIDGET (window), img, title, msg, SYSTEM_SUSPEND);
+	show_command_dialog (window, img, title, msg, SYSTEM_SUSPEND);
 }
 
 static void
@@ -1936,18 +3236,21 @@ hibernate_button_clicked_cb (GtkButton *button, gpointer user_data)
 	title = _("System Hibernate");
 	msg = _("Are you sure you want to hibernate the computer?");
 
-	show_command_dialog (GTK_WIDGET (window), img, title, msg, SYSTEM_HIBERNATE);
+	show_command_dialog (window, img, title, msg, SYSTEM_HIBERNATE);
 }
 
 static void
 load_power_command (GreeterWindow *window)
 {
+	gint type;
 	GreeterWindowPrivate *priv = window->priv;
 
-	gtk_widget_set_visible (priv->btn_shutdown, lightdm_get_can_shutdown ());
-	gtk_widget_set_visible (priv->btn_restart, lightdm_get_can_restart ());
-	gtk_widget_set_visible (priv->btn_suspend, lightdm_get_can_suspend ());
-	gtk_widget_set_visible (priv->btn_hibernate, lightdm_get_can_hibernate ());
+	/* Revealed once the capabilities are known */
+	for (type = 0; type < SYSTEM_LAST; type++)
+		power_capability_update (window, type, FALSE);
+
+	priv->power_cancellable = g_cancellable_new ();
+	g_signal_connect_after (window, "draw", G_CALLBACK (power_capabilities_probe_draw_cb), NULL);
 
 	g_signal_connect (G_OBJECT (priv->btn_shutdown), "clicked",
                       G_CALLBACK (shutdown_button_clicked_cb), window);
@@ -1962,6 +3265,7 @@ load_power_command (GreeterWindow *window)
 static void
 lightdm_greeter_init (GreeterWindow *window)
 {
+	const gchar *phase;
 	GreeterWindowPrivate *priv = window->priv;
 
 	priv->lightdm = lightdm_greeter_new ();
@@ -1975,7 +3279,9 @@ lightdm_greeter_init (GreeterWindow *window)
 	/* set default session */
 	set_session (window, lightdm_greeter_get_default_session_hint (priv->lightdm));
 
+	phase = greeter_watchdog_enter ("lightdm-connect");
 	lightdm_greeter_connect_sync (priv->lightdm, NULL);
+	greeter_watchdog_leave (phase);
 }
 
 static void
@@ -1984,6 +3290,53 @@ greeter_window_finalize (GObject *object)
 	GreeterWindow *window = GREETER_WINDOW (object);
 	GreeterWindowPrivate *priv = window->priv;
 
+	g_clear_handle_id (&priv->clock_timeout_id, g_source_remove);
+	g_clear_handle_id (&priv->switch_menu_free_id, g_source_remove);
+	g_clear_pointer (&priv->clock_format, g_free);
+	g_clear_pointer (&priv->clock_text, g_free);
+
+	if (priv->power_cancellable) {
+		g_cancellable_cancel (priv->power_cancellable);
+		g_clear_object (&priv->power_cancellable);
+	}
+
+	if (priv->accounts_cancellable) {
+		g_cancellable_cancel (priv->accounts_cancellable);
+		g_clear_object (&priv->accounts_cancellable);
+	}
+
+	if (priv->login1_proxy) {
+		g_signal_handlers_disconnect_by_data (priv->login1_proxy, window);
+		g_clear_object (&priv->login1_proxy);
+	}
+
+	if (priv->splash) {
+		splash_window_destroy (priv->splash);
+		g_clear_object (&priv->splash);
+	}
+
+	g_slist_free_full (priv->dialog_pool, (GDestroyNotify) gtk_widget_destroy);
+	priv->dialog_pool = NULL;
+
+	if (priv->cleanmode_cancellable) {
+		g_cancellable_cancel (priv->cleanmode_cancellable);
+		g_clear_object (&priv->cleanmode_cancellable);
+	}
+	g_clear_object (&priv->agent_conf_monitor);
+
+	if (priv->up_cancellable) {
+		g_cancellable_cancel (priv->up_cancellable);
+		g_clear_object (&priv->up_cancellable);
+	}
+
+	if (priv->up_client)
+		g_signal_handlers_disconnect_by_data (priv->up_client, window);
+
+	g_clear_handle_id (&priv->indicator_flush_id, g_source_remove);
+	g_clear_pointer (&priv->pending_indicators, g_slist_free);
+	g_clear_pointer (&priv->indicator_entries, g_hash_table_destroy);
+	g_clear_pointer (&priv->battery_devices, g_hash_table_destroy);
+
 	g_clear_pointer (&priv->devices, g_ptr_array_unref);
 	g_clear_object (&priv->up_client);
 
@@ -2008,6 +3361,14 @@ greeter_window_init (GreeterWindow *window)
 
 	gtk_widget_init_template (GTK_WIDGET (window));
 
+	/* Replaced before the first draw, so the theme is never searched for them */
+	greeter_image_set_icon_name (GTK_IMAGE (priv->img_shutdown), "system-shutdown-symbolic", GTK_ICON_SIZE_LARGE_TOOLBAR);
+	greeter_image_set_icon_name (GTK_IMAGE (priv->img_restart), "system-restart-symbolic", GTK_ICON_SIZE_LARGE_TOOLBAR);
+	greeter_image_set_icon_name (GTK_IMAGE (priv->img_suspend), "system-suspend-symbolic", GTK_ICON_SIZE_LARGE_TOOLBAR);
+	greeter_image_set_icon_name (GTK_IMAGE (priv->img_hibernate), "system-hibernate-symbolic", GTK_ICON_SIZE_LARGE_TOOLBAR);
+
+	greeter_spinner_attach (priv->spinner);
+
 	priv->prompted = FALSE;
 	priv->prompt_active = FALSE;
 	priv->have_pam_error = FALSE;
@@ -2019,7 +3380,34 @@ greeter_window_init (GreeterWindow *window)
 	priv->pw = NULL;
 	priv->devices = NULL;
 	priv->up_client = NULL;
+	priv->up_cancellable = NULL;
+	priv->cleanmode_allowed = TRUE;
+	priv->cleanmode_busy = FALSE;
+	priv->cleanmode_cancellable = NULL;
+	priv->agent_conf_monitor = NULL;
+	priv->indicator_entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	priv->battery_devices = g_hash_table_new (g_direct_hash, g_direct_equal);
+	priv->pending_indicators = NULL;
+	priv->indicator_flush_id = 0;
+	priv->splash = NULL;
+	priv->switch_menu = NULL;
+	priv->switch_menu_serial = 0;
+	priv->switch_menu_free_id = 0;
+	priv->dialog_pool = NULL;
+	priv->login1_proxy = NULL;
+	priv->power_cancellable = NULL;
+	priv->command_pending = FALSE;
+	priv->accounts_cancellable = NULL;
+	priv->clock_label = NULL;
+	priv->clock_format = NULL;
+	priv->clock_text = NULL;
+	priv->clock_timeout_id = 0;
 	priv->changing_password_step = 0;
+	priv->login_time = 0;
+	priv->speculating = FALSE;
+	priv->cancelling = FALSE;
+	priv->speculation_ended = FALSE;
+	priv->speculative_auth = config_get_bool (NULL, CONFIG_KEY_SPECULATIVE_AUTH, FALSE);
 
 	lightdm_greeter_init (window);
 
@@ -2033,6 +3421,8 @@ greeter_window_init (GreeterWindow *window)
 
 	g_signal_connect (priv->id_entry, "changed", G_CALLBACK (id_entry_changed_cb), window);
 	g_signal_connect (priv->id_entry, "key-press-event", G_CALLBACK (id_entry_key_press_cb), window);
+	if (priv->speculative_auth)
+		g_signal_connect (priv->pw_entry, "focus-in-event", G_CALLBACK (pw_entry_focus_in_cb), window);
 	g_signal_connect (priv->pw_entry, "activate", G_CALLBACK (pw_entry_activate_cb), window);
 	g_signal_connect (priv->login_button, "clicked", G_CALLBACK (login_button_clicked_cb), window);
 	g_signal_connect (priv->cleanmode_switch, "state-set", G_CALLBACK (cleanmode_flag_state_set_cb), window);
@@ -2071,6 +3461,10 @@ greeter_window_class_init (GreeterWindowClass *klass)
 	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, btn_restart);
 	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, btn_suspend);
 	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, btn_hibernate);
+	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, img_shutdown);
+	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, img_restart);
+	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, img_suspend);
+	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, img_hibernate);
 	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, cm_box);
 	gtk_widget_class_bind_template_child_private (widget_class, GreeterWindow, cleanmode_switch);
 }
@@ -2094,3 +3488,74 @@ greeter_window_set_switch_indicator_visible (GreeterWindow *window, gboolean vis
 		gtk_widget_hide (window->priv->switch_indicator);
 	}
 }
+
+void
+greeter_window_set_active_monitor (GreeterWindow      *window,
+                                   const GdkRectangle *geometry,
+                                   gint                scale_factor,
+                                   GdkPixbuf          *background,
+                                   const GdkRGBA      *color)
+{
+	GtkWidget *toplevel;
+	GreeterWindowPrivate *priv;
+
+	g_return_if_fail (GREETER_IS_WINDOW (window));
+	g_return_if_fail (geometry != NULL);
+
+	priv = window->priv;
+
+	priv->active_geometry = *geometry;
+	if (priv->switch_menu)
+		switch_menu_sync_active (window);
+
+	toplevel = gtk_widget_get_toplevel (GTK_WIDGET (window));
+	if (!GTK_IS_WINDOW (toplevel))
+		return;
+
+	if (!priv->splash) {
+		priv->splash = splash_window_new (GTK_WINDOW (toplevel));
+		g_object_ref_sink (priv->splash);
+	}
+
+	/* Have one dialog realized before the first PAM message arrives */
+	if (!priv->dialog_pool && !greeter_memory_is_low ()) {
+		GtkWidget *dialog = greeter_message_dialog_new (GTK_WINDOW (toplevel), NULL, NULL, NULL);
+		gtk_widget_realize (dialog);
+		priv->dialog_pool = g_slist_prepend (NULL, dialog);
+	}
+
+	splash_window_set_monitor (priv->splash, GTK_WINDOW (toplevel), geometry, scale_factor,
+                               background, color);
+}
+
+/* Load time and RSS growth of every indicator module with entries shown,
+ * logged on SIGUSR1 */
+void
+greeter_window_report_indicators (GreeterWindow *window)
+{
+	GHashTableIter iter;
+	IndicatorEntry *registered;
+	GHashTable *reported;
+
+	g_return_if_fail (GREETER_IS_WINDOW (window));
+
+	reported = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	g_hash_table_iter_init (&iter, window->priv->indicator_entries);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &registered)) {
+		const IndicatorLoad *load;
+
+		if (!g_hash_table_add (reported, registered->io))
+			continue;
+
+		load = g_object_get_data (G_OBJECT (registered->io), "io-load");
+		if (!load)
+			continue;
+
+		g_message ("[Indicator] %s: loaded in %.1f ms, RSS %+.1f KiB",
+                   (const gchar *) g_object_get_data (G_OBJECT (registered->io), "io-name"),
+                   load->load_ms, load->rss / 1024.0);
+	}
+
+	g_hash_table_destroy (reported);
+}
@@ -47,6 +47,14 @@ GtkWidget  *greeter_window_new                          (void);
 void        greeter_window_set_switch_indicator_visible (GreeterWindow *window,
                                                          gboolean       visible);
 
+void        greeter_window_set_active_monitor           (GreeterWindow      *window,
+                                                         const GdkRectangle *geometry,
+                                                         gint                scale_factor,
+                                                         GdkPixbuf          *background,
+                                                         const GdkRGBA      *color);
+
+void        greeter_window_report_indicators            (GreeterWindow *window);
+
 G_END_DECLS
 
 #endif /* __GREETER_WINDOW_H__ */
@@ -26,6 +26,10 @@
 #include <glib/gi18n.h>
 
 #include "greeterbackground.h"
+#include "greeter-monitor-topology.h"
+#include "greeter-profile.h"
+#include "greeter-memory.h"
+#include "greeterconfiguration.h"
 
 typedef enum
 {
@@ -81,6 +85,11 @@ typedef struct
 		GdkPixbuf* image;
 		GdkRGBA color;
 	} options;
+	/* The image at device resolution, painted 1:1. In low-memory mode this
+	 * is a 16-bit surface and the pixbuf is not kept. */
+	cairo_surface_t* surface;
+	/* Device pixels per logical pixel of the image */
+	gint scale;
 } Background;
 
 typedef struct
@@ -89,8 +98,11 @@ typedef struct
 	gint number;
 	gchar* name;
 	GdkRectangle geometry;
+	gint scale_factor;
 	GtkWindow* window;
 	gulong window_draw_handler_id;
+	/* Background uploaded to the X server, NULL when painted by the client */
+	cairo_surface_t* server_surface;
 
 	Background* background;
 
@@ -128,6 +140,10 @@ struct _GreeterBackgroundPrivate
 	GdkScreen* screen;
 	gulong monitors_changed_handler_id;
 
+	/* Shared monitor layout, the windows below follow its serial */
+	GreeterMonitorTopology* topology;
+	guint topology_serial;
+
 	GtkWidget* child;
 
     /* List of groups <GtkAccelGroup*> for greeter screens windows */
@@ -143,15 +159,13 @@ struct _GreeterBackgroundPrivate
     /* Name => <Monitor*>, "Number" => <Monitor*> */
 	GHashTable* monitors_map;
 
+	gboolean server_side_background;
+
 	const Monitor* active_monitor;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE(GreeterBackground, greeter_background, G_TYPE_OBJECT);
 
-/* Implemented in gooroom-greeter.c */
-gpointer greeter_save_focus(GtkWidget* widget);
-void greeter_restore_focus(const gpointer saved_data);
-
 static const MonitorConfig DEFAULT_MONITOR_CONFIG =
 {
     .bg =
@@ -174,6 +188,7 @@ background_finalize (Background* bg)
 	{
 		case BACKGROUND_TYPE_IMAGE:
 			g_clear_object (&bg->options.image);
+			g_clear_pointer (&bg->surface, cairo_surface_destroy);
 			break;
 		case BACKGROUND_TYPE_COLOR:
 			break;
@@ -192,8 +207,9 @@ background_unref (Background** bg)
 	(*bg)->ref_count--;
 	if ((*bg)->ref_count == 0) {
 		background_finalize (*bg);
-		*bg = NULL;
+		g_free (*bg);
 	}
+	*bg = NULL;
 }
 
 static void
@@ -229,6 +245,7 @@ monitor_finalize (Monitor* monitor)
 		g_signal_handler_disconnect (monitor->window, monitor->window_draw_handler_id);
 
 	background_unref (&monitor->background);
+	g_clear_pointer (&monitor->server_surface, cairo_surface_destroy);
 
 	if (monitor->window) {
 		GtkWidget* child = gtk_bin_get_child (GTK_BIN (monitor->window));
@@ -403,11 +420,17 @@ greeter_background_set_cursor_position (GreeterBackground* background, gint x, g
 }
 
 static void
-greeter_background_monitors_changed_cb (GdkScreen* screen, GreeterBackground* background)
+greeter_background_topology_changed_cb (GreeterMonitorTopology* topology,
+                                        const GreeterTopology*  snapshot,
+                                        GreeterBackground*      background)
 {
 	g_return_if_fail (GREETER_IS_BACKGROUND (background));
 
-	greeter_background_connect (background, screen);
+	/* Only the active output changed */
+	if (snapshot->serial == background->priv->topology_serial)
+		return;
+
+	greeter_background_connect (background, background->priv->screen);
 }
 
 //static void
@@ -428,8 +451,8 @@ monitor_draw_background (const Monitor* monitor,
 	switch(background->type)
 	{
 		case BACKGROUND_TYPE_IMAGE:
-			if(background->options.image) {
-				gdk_cairo_set_source_pixbuf(cr, background->options.image, 0, 0);
+			if(background->surface) {
+				cairo_set_source_surface(cr, background->surface, 0, 0);
 				cairo_paint(cr);
 			}
 			break;
@@ -456,6 +479,44 @@ monitor_window_draw_cb (GtkWidget* widget,
 	return FALSE;
 }
 
+/* Uploads the background once into an X pixmap and makes it the window
+ * background, so exposures are repainted by the X server itself */
+static gboolean
+monitor_set_server_background (Monitor* monitor)
+{
+	cairo_t* cr;
+	GdkWindow* window;
+	cairo_pattern_t* pattern;
+
+	if (!monitor->background || !GDK_IS_X11_DISPLAY (gdk_display_get_default ()))
+		return FALSE;
+
+	gtk_widget_realize (GTK_WIDGET (monitor->window));
+	window = gtk_widget_get_window (GTK_WIDGET (monitor->window));
+
+	monitor->server_surface = gdk_window_create_similar_surface (window, CAIRO_CONTENT_COLOR,
+                                                                 monitor->geometry.width,
+                                                                 monitor->geometry.height);
+	if (cairo_surface_get_type (monitor->server_surface) != CAIRO_SURFACE_TYPE_XLIB) {
+		g_clear_pointer (&monitor->server_surface, cairo_surface_destroy);
+		return FALSE;
+	}
+
+	cr = cairo_create (monitor->server_surface);
+	monitor_draw_background (monitor, monitor->background, cr);
+	cairo_destroy (cr);
+
+	pattern = cairo_pattern_create_for_surface (monitor->server_surface);
+	/* GDK clears each paint buffer from the pixmap on the server side, the
+	 * client only draws the login panel of the active monitor over it */
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+	gdk_window_set_background_pattern (window, pattern);
+G_GNUC_END_IGNORE_DEPRECATIONS
+	cairo_pattern_destroy (pattern);
+
+	return TRUE;
+}
+
 static gboolean
 background_config_initialize (BackgroundConfig* config, const gchar* value)
 {
@@ -485,23 +546,57 @@ background_config_initialize (BackgroundConfig* config, const gchar* value)
 	return TRUE;
 }
 
+/* Wallpapers are opaque, so two bytes per pixel are enough on thin clients */
+static cairo_surface_t*
+compact_surface_create_from_pixbuf (const GdkPixbuf* pixbuf, gint scale)
+{
+	cairo_t* cr;
+	cairo_surface_t* surface;
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_RGB16_565,
+                                          gdk_pixbuf_get_width (pixbuf),
+                                          gdk_pixbuf_get_height (pixbuf));
+
+	cr = cairo_create (surface);
+	gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	cairo_surface_set_device_scale (surface, scale, scale);
+
+	return surface;
+}
+
 static Background*
 background_new (const BackgroundConfig* config, const Monitor* monitor, GHashTable* images_cache)
 {
 	Background bg = {0};
 
+	bg.scale = 1;
+
 	switch (config->type)
 	{
 		case BACKGROUND_TYPE_IMAGE:
+			/* Scaled to device pixels, so HiDPI monitors get a sharp image.
+			 * An unscaled source image keeps one pixel per logical pixel. */
+			if (config->options.image.mode != SCALING_MODE_SOURCE)
+				bg.scale = monitor->scale_factor;
 			bg.options.image = scale_image_file (config->options.image.path,
                                                  config->options.image.mode,
-                                                 monitor->geometry.width,
-                                                 monitor->geometry.height,
+                                                 monitor->geometry.width * bg.scale,
+                                                 monitor->geometry.height * bg.scale,
                                                  images_cache);
 			if (!bg.options.image) {
 				g_warning ("[Background] Failed to read wallpaper: %s", config->options.image.path);
 				return NULL;
 			}
+			if (greeter_memory_is_low ()) {
+				bg.surface = compact_surface_create_from_pixbuf (bg.options.image, bg.scale);
+				g_clear_object (&bg.options.image);
+			} else {
+				bg.surface = gdk_cairo_surface_create_from_pixbuf (bg.options.image,
+                                                                   bg.scale, NULL);
+			}
 			break;
 		case BACKGROUND_TYPE_COLOR:
 			bg.options.color = config->options.color;
@@ -526,7 +621,7 @@ greeter_background_disconnect (GreeterBackground* background)
 	GreeterBackgroundPrivate* priv = background->priv;
 
 	if (priv->monitors_changed_handler_id)
-		g_signal_handler_disconnect (priv->screen, priv->monitors_changed_handler_id);
+		g_signal_handler_disconnect (priv->topology, priv->monitors_changed_handler_id);
 	priv->monitors_changed_handler_id = 0;
 	priv->screen = NULL;
 	priv->active_monitor = NULL;
@@ -543,6 +638,42 @@ greeter_background_disconnect (GreeterBackground* background)
 	priv->monitors_map = NULL;
 }
 
+/* Keyboard focus of the login panel, kept while it moves between windows */
+typedef struct
+{
+	GtkWidget* widget;
+	gint editable_pos;
+} SavedFocus;
+
+static void
+saved_focus_take (SavedFocus* saved, GtkWidget* child)
+{
+	GtkWidget* toplevel = gtk_widget_get_toplevel (child);
+
+	saved->widget = NULL;
+	saved->editable_pos = -1;
+
+	if (!GTK_IS_WINDOW (toplevel) || !gtk_window_get_focus (GTK_WINDOW (toplevel)))
+		return;
+
+	saved->widget = g_object_ref (gtk_window_get_focus (GTK_WINDOW (toplevel)));
+	if (GTK_IS_EDITABLE (saved->widget))
+		saved->editable_pos = gtk_editable_get_position (GTK_EDITABLE (saved->widget));
+}
+
+static void
+saved_focus_restore (SavedFocus* saved)
+{
+	if (!saved->widget)
+		return;
+
+	gtk_widget_grab_focus (saved->widget);
+	if (saved->editable_pos > -1)
+		gtk_editable_set_position (GTK_EDITABLE (saved->widget), saved->editable_pos);
+
+	g_clear_object (&saved->widget);
+}
+
 static void
 greeter_background_set_active_monitor (GreeterBackground* background, const Monitor* active)
 {
@@ -559,20 +690,13 @@ greeter_background_set_active_monitor (GreeterBackground* background, const Moni
 	if (!active) {
 		/* Using primary monitor */
 		if (!active) {
-			gint i;
-			GdkDisplay *display;
+			const GreeterTopology* snapshot;
 
-			display = gdk_display_get_default ();
+			snapshot = greeter_monitor_topology_get_snapshot (priv->topology);
+			if (snapshot->primary < priv->monitors_size)
+				active = &priv->monitors[snapshot->primary];
 
-			for (i = 0; i < priv->monitors_size; i++) {
-				GdkMonitor *gdk_monitor = gdk_display_get_monitor (display, i);
-				if (gdk_monitor_is_primary (gdk_monitor)) {
-					active = &priv->monitors[i];
-					break;
-				}
-			}
-
-			if (!active->background)
+			if (active && !active->background)
 				active = NULL;
 			if (active)
 				g_debug ("[Background] Active monitor is not specified, using primary monitor");
@@ -608,17 +732,19 @@ greeter_background_set_active_monitor (GreeterBackground* background, const Moni
 
 	g_return_if_fail (priv->active_monitor != NULL);
 
+	/* The child is drawn by the active monitor window, over the wallpaper
+	 * that window paints anyway */
 	if (priv->child) {
-		GtkWidget* old_parent = gtk_widget_get_parent(priv->child);
-		gpointer focus = greeter_save_focus (priv->child);
-		if (old_parent) {
+		SavedFocus focus;
+		GtkWidget* old_parent = gtk_widget_get_parent (priv->child);
+
+		saved_focus_take (&focus, priv->child);
+		if (old_parent)
 			gtk_container_remove (GTK_CONTAINER (old_parent), priv->child);
-		}
 
 		gtk_container_add (GTK_CONTAINER (active->window), priv->child);
 		gtk_window_present (active->window);
-		greeter_restore_focus (focus);
-		g_free (focus);
+		saved_focus_restore (&focus);
 	} else {
 		g_warning ("[Background] Child widget is destroyed or not defined");
 	}
@@ -626,6 +752,8 @@ greeter_background_set_active_monitor (GreeterBackground* background, const Moni
 	g_debug ("[Background] Active monitor changed to: %s #%d", active->name, active->number);
 	g_signal_emit (background, background_signals[BACKGROUND_SIGNAL_ACTIVE_MONITOR_CHANGED], 0);
 
+	greeter_monitor_topology_set_active (priv->topology, active->number);
+
 	gint x, y;
 	greeter_background_get_cursor_position (background, &x, &y);
 	/* Do not center cursor if it is already inside active monitor */
@@ -645,6 +773,7 @@ greeter_background_finalize (GObject *object)
 	greeter_background_disconnect (background);
 
 	g_clear_object (&background->priv->child);
+	g_clear_object (&background->priv->topology);
 
 	G_OBJECT_CLASS (greeter_background_parent_class)->finalize (object);
 }
@@ -657,6 +786,9 @@ greeter_background_init (GreeterBackground* self)
 
 	priv->screen = NULL;
 	priv->monitors_changed_handler_id = 0;
+	priv->topology = g_object_ref (greeter_monitor_topology_get_default ());
+	priv->topology_serial = 0;
+	priv->server_side_background = config_get_bool (NULL, CONFIG_KEY_SERVER_BACKGROUND, FALSE);
 	priv->accel_groups = NULL;
 
 	priv->default_monitor_config = monitor_config_copy (&DEFAULT_MONITOR_CONFIG, NULL);
@@ -727,55 +859,58 @@ greeter_background_connect (GreeterBackground* background, GdkScreen* screen)
 	g_debug ("[Background] Connecting to screen: %p", screen);
 
 	GreeterBackgroundPrivate* priv = background->priv;
-	gpointer saved_focus = NULL;
+	SavedFocus focus = { NULL, -1 };
 	if (priv->screen) {
+		/* The monitor windows holding the child are destroyed below */
 		if (priv->active_monitor)
-			saved_focus = greeter_save_focus (priv->child);
+			saved_focus_take (&focus, priv->child);
 		greeter_background_disconnect (background);
 	}
 
-	GdkDisplay *display = gdk_display_get_default ();
+	const GreeterTopology *snapshot = greeter_monitor_topology_get_snapshot (priv->topology);
 
 	priv->screen = screen;
-	priv->monitors_size = gdk_display_get_n_monitors (display);
+	priv->topology_serial = snapshot->serial;
+	priv->monitors_size = snapshot->n_outputs;
 	priv->monitors = g_new0 (Monitor, priv->monitors_size);
 	priv->monitors_map = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
 	g_debug("[Background] Monitors found: %" G_GSIZE_FORMAT, priv->monitors_size);
 
-	GHashTable* images_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
-	cairo_region_t *screen_region = cairo_region_create ();
+	GHashTable* images_cache = NULL;
 	gint i;
 
+	/* The cache holds a full decoded copy of every wallpaper until all
+	 * monitors are set up; decoding once per monitor is cheaper on memory */
+	if (!greeter_memory_is_low ())
+		images_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+
 	for (i = 0; i < priv->monitors_size; ++i) {
-		GdkMonitor *gdk_monitor;
+		const GreeterOutput *output = &snapshot->outputs[i];
 		const MonitorConfig* monitor_config;
 		const gchar* printable_name;
 		Monitor* monitor = &priv->monitors[i];
-		gdk_monitor = gdk_display_get_monitor (display, i);
 
 		monitor->object = background;
-		monitor->name = g_strdup (gdk_monitor_get_model (gdk_monitor));
+		monitor->name = g_strdup (output->model);
 		monitor->number = i;
 
 		printable_name = monitor->name ? monitor->name : "<unknown>";
 
-		gdk_monitor_get_geometry (gdk_monitor, &monitor->geometry);
+		monitor->geometry = output->geometry;
+		monitor->scale_factor = MAX (output->scale_factor, 1);
 
-		g_debug ("[Background] Monitor: %s #%d (%dx%d at %dx%d)%s", printable_name, i,
+		g_debug ("[Background] Monitor: %s #%d (%dx%d at %dx%d, scale %d)%s", printable_name, i,
                  monitor->geometry.width, monitor->geometry.height,
-                 monitor->geometry.x, monitor->geometry.y,
-                 (i == gdk_monitor_is_primary (gdk_monitor)) ? " primary" : "");
+                 monitor->geometry.x, monitor->geometry.y, monitor->scale_factor,
+                 output->primary ? " primary" : "");
 
 		monitor_config = priv->default_monitor_config;
 
-		/* Simple check to skip fully overlapped monitors.
-		   Actually, it's can track only monitors in "mirrors" mode. Nothing more. */
-		if (cairo_region_contains_rectangle (screen_region, &monitor->geometry) == CAIRO_REGION_OVERLAP_IN) {
+		if (output->mirror_of >= 0) {
 			g_debug ("[Background] Skipping monitor %s #%d, its area is already used by other monitors", printable_name, i);
 			continue;
 		}
-		cairo_region_union_rectangle (screen_region, &monitor->geometry);
 
 		monitor->window = GTK_WINDOW (gtk_window_new (GTK_WINDOW_TOPLEVEL));
 		gtk_window_set_type_hint (monitor->window, GDK_WINDOW_TYPE_HINT_DESKTOP);
@@ -787,9 +922,7 @@ greeter_background_connect (GreeterBackground* background, GdkScreen* screen)
                                      monitor->geometry.width, monitor->geometry.height);
 		gtk_window_move (monitor->window, monitor->geometry.x, monitor->geometry.y);
 
-		monitor->window_draw_handler_id = g_signal_connect (G_OBJECT (monitor->window), "draw",
-                                                            G_CALLBACK (monitor_window_draw_cb),
-                                                            monitor);
+		greeter_profile_track_frames (GTK_WIDGET (monitor->window), "background");
 
 		GSList* item = NULL;
 		for (item = priv->accel_groups; item != NULL; item = g_slist_next(item))
@@ -802,24 +935,29 @@ greeter_background_connect (GreeterBackground* background, GdkScreen* screen)
 		if (!monitor->background)
 			monitor->background = background_new (&DEFAULT_MONITOR_CONFIG.bg, monitor, images_cache);
 
+		if (!priv->server_side_background || !monitor_set_server_background (monitor))
+			monitor->window_draw_handler_id = g_signal_connect (G_OBJECT (monitor->window), "draw",
+                                                                G_CALLBACK (monitor_window_draw_cb),
+                                                                monitor);
+		else if (greeter_memory_is_low () && monitor->background)
+			/* The X server has its own copy now */
+			g_clear_pointer (&monitor->background->surface, cairo_surface_destroy);
+
 		if (monitor->name)
 			g_hash_table_insert (priv->monitors_map, g_strdup (monitor->name), monitor);
 		g_hash_table_insert (priv->monitors_map, g_strdup_printf ("%d", i), monitor);
 
 		gtk_widget_show_all (GTK_WIDGET (monitor->window));
 	}
-	g_hash_table_unref (images_cache);
+	g_clear_pointer (&images_cache, g_hash_table_unref);
 
 	if (!priv->active_monitor)
 		greeter_background_set_active_monitor (background, NULL);
 
-	if (saved_focus) {
-		greeter_restore_focus (saved_focus);
-		g_free (saved_focus);
-	}
+	saved_focus_restore (&focus);
 
-	priv->monitors_changed_handler_id = g_signal_connect (G_OBJECT (screen), "monitors-changed",
-			G_CALLBACK (greeter_background_monitors_changed_cb), background);
+	priv->monitors_changed_handler_id = g_signal_connect (G_OBJECT (priv->topology), "changed",
+			G_CALLBACK (greeter_background_topology_changed_cb), background);
 }
 
 GdkPixbuf *
@@ -835,7 +973,8 @@ greeter_background_pixbuf_get (GreeterBackground* background)
 
 	bg = priv->active_monitor->background;
 
-	if (!bg)
+	/* Not kept in low-memory mode */
+	if (!bg || bg->type != BACKGROUND_TYPE_IMAGE)
 		return NULL;
 
 	return bg->options.image;
@@ -850,6 +989,37 @@ greeter_background_get_active_monitor_geometry (GreeterBackground* background)
     return priv->active_monitor ? &priv->active_monitor->geometry : NULL;
 }
 
+/* Device pixels per logical pixel of the active monitor's wallpaper,
+ * 1 for an unscaled (#source) image */
+gint
+greeter_background_get_active_monitor_scale (GreeterBackground* background)
+{
+    g_return_val_if_fail(GREETER_IS_BACKGROUND(background), 1);
+    GreeterBackgroundPrivate* priv = background->priv;
+
+    if (!priv->active_monitor || !priv->active_monitor->background)
+        return 1;
+
+    return priv->active_monitor->background->scale;
+}
+
+/* FALSE unless the active monitor has a colour background */
+gboolean
+greeter_background_get_active_monitor_color (GreeterBackground* background,
+                                             GdkRGBA*           color)
+{
+    g_return_val_if_fail(GREETER_IS_BACKGROUND(background), FALSE);
+    g_return_val_if_fail(color != NULL, FALSE);
+    GreeterBackgroundPrivate* priv = background->priv;
+
+    if (!priv->active_monitor || !priv->active_monitor->background ||
+        priv->active_monitor->background->type != BACKGROUND_TYPE_COLOR)
+        return FALSE;
+
+    *color = priv->active_monitor->background->options.color;
+    return TRUE;
+}
+
 void
 greeter_background_add_accel_group (GreeterBackground* background,
                                     GtkAccelGroup* group)
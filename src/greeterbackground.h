@@ -44,6 +44,9 @@ void greeter_background_add_accel_group             (GreeterBackground* backgrou
 GdkPixbuf *greeter_background_pixbuf_get            (GreeterBackground* background);
 
 const GdkRectangle* greeter_background_get_active_monitor_geometry (GreeterBackground* background);
+gint greeter_background_get_active_monitor_scale    (GreeterBackground* background);
+gboolean greeter_background_get_active_monitor_color (GreeterBackground* background,
+                                                      GdkRGBA*           color);
 
 void  greeter_background_set_active_monitor_from_geometry (GreeterBackground  *background,
                                                            const GdkRectangle *geometry);
@@ -97,6 +97,11 @@ config_init(void)
 
     files = g_list_reverse(files);
 
+    /* Read last, so it overrides the system files; used by tests/greeter-harness */
+    const gchar* extra_config = g_getenv("GOOROOM_GREETER_CONFIG");
+    if(extra_config && g_file_test(extra_config, G_FILE_TEST_IS_REGULAR))
+        files = g_list_append(files, g_strdup(extra_config));
+
     GKeyFile* tmp_config = NULL;
     GList* file_iter = NULL;
     for(file_iter = files; file_iter; file_iter = g_list_next(file_iter))
@@ -28,6 +28,17 @@
 #define CONFIG_KEY_RGBA                 "xft-rgba"
 #define CONFIG_KEY_KEYBOARD             "keyboard"
 #define CONFIG_KEY_BACKGROUND           "background"
+#define CONFIG_KEY_SPECULATIVE_AUTH     "speculative-authentication"
+#define CONFIG_KEY_PROFILING            "profiling"
+#define CONFIG_KEY_LEAK_CHECK_INTERVAL  "leak-check-interval"
+#define CONFIG_KEY_STALL_THRESHOLD      "stall-threshold"
+#define CONFIG_KEY_FRAME_TIMING         "frame-timing"
+#define CONFIG_KEY_SPINNER_MODE         "spinner-mode"
+#define CONFIG_KEY_SERVER_BACKGROUND    "server-side-background"
+#define CONFIG_KEY_ACCESSIBILITY        "accessibility"
+#define CONFIG_KEY_THEME_MODE           "theme-mode"
+#define CONFIG_KEY_LOW_MEMORY           "low-memory"
+#define CONFIG_KEY_MEMORY_BUDGET        "memory-budget"
 #define STATE_SECTION_GREETER           "/greeter"
 
 
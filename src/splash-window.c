@@ -17,11 +17,22 @@
 #include <gtk/gtk.h>
 
 #include "splash-window.h"
+#include "greeter-profile.h"
+#include "greeter-spinner.h"
+
+/* Same dimming as the .splash-window-box background in theme.css */
+#define SPLASH_DIM_ALPHA 0.1
 
 
 struct _SplashWindowPrivate
 {
 	GtkWidget *spinner;
+
+	/* Pre-dimmed monitor background, NULL to blend over it */
+	cairo_pattern_t *backdrop;
+
+	/* Set by splash_window_set_monitor () */
+	gboolean placed;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (SplashWindow, splash_window, GTK_TYPE_WINDOW);
@@ -30,9 +41,94 @@ G_DEFINE_TYPE_WITH_PRIVATE (SplashWindow, splash_window, GTK_TYPE_WINDOW);
 static void
 splash_window_finalize (GObject *object)
 {
+	SplashWindow *window = SPLASH_WINDOW (object);
+
+	g_clear_pointer (&window->priv->backdrop, cairo_pattern_destroy);
+
 	G_OBJECT_CLASS (splash_window_parent_class)->finalize (object);
 }
 
+static gboolean
+splash_window_draw_cb (GtkWidget *widget,
+                       cairo_t   *cr,
+                       gpointer   user_data)
+{
+	SplashWindow *window = SPLASH_WINDOW (widget);
+
+	if (!window->priv->backdrop)
+		return FALSE;
+
+	/* Only the invalidated spinner area is repainted from the backdrop */
+	cairo_save (cr);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source (cr, window->priv->backdrop);
+	cairo_paint (cr);
+	cairo_restore (cr);
+
+	return FALSE;
+}
+
+static void
+splash_window_set_backdrop (SplashWindow       *window,
+                            const GdkRectangle *geometry,
+                            gint                scale,
+                            GdkPixbuf          *background,
+                            const GdkRGBA      *color)
+{
+	cairo_t *cr;
+	cairo_surface_t *surface;
+	GtkStyleContext *style;
+	SplashWindowPrivate *priv = window->priv;
+
+	g_clear_pointer (&priv->backdrop, cairo_pattern_destroy);
+
+	style = gtk_widget_get_style_context (gtk_bin_get_child (GTK_BIN (window)));
+
+	if (background) {
+		/* The wallpaper is rendered at the monitor's device resolution, and
+		 * drawn from the top left corner like the monitor window does */
+		surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+                                              geometry->width * scale, geometry->height * scale);
+
+		cr = cairo_create (surface);
+		gdk_cairo_set_source_pixbuf (cr, background, 0, 0);
+		cairo_paint (cr);
+		cairo_set_source_rgba (cr, 0, 0, 0, SPLASH_DIM_ALPHA);
+		cairo_paint (cr);
+		cairo_destroy (cr);
+
+		cairo_surface_set_device_scale (surface, scale, scale);
+
+		priv->backdrop = cairo_pattern_create_for_surface (surface);
+		cairo_surface_destroy (surface);
+	} else if (color) {
+		/* The same colour dimmed by black at SPLASH_DIM_ALPHA */
+		priv->backdrop = cairo_pattern_create_rgb (color->red * (1 - SPLASH_DIM_ALPHA),
+                                                   color->green * (1 - SPLASH_DIM_ALPHA),
+                                                   color->blue * (1 - SPLASH_DIM_ALPHA));
+	}
+
+	/* The dimming is already in the backdrop */
+	if (priv->backdrop)
+		gtk_style_context_remove_class (style, "splash-window-box");
+	else
+		gtk_style_context_add_class (style, "splash-window-box");
+}
+
+/* Opaque for a backdrop, the RGBA visual to be blended over the
+ * wallpaper by the compositor otherwise */
+static GdkVisual *
+splash_window_get_visual (SplashWindow *window, gboolean opaque)
+{
+	GdkVisual *visual = NULL;
+	GdkScreen *screen = gtk_window_get_screen (GTK_WINDOW (window));
+
+	if (!opaque && gdk_screen_is_composited (screen))
+		visual = gdk_screen_get_rgba_visual (screen);
+
+	return visual ? visual : gdk_screen_get_system_visual (screen);
+}
+
 static void
 splash_window_init (SplashWindow *window)
 {
@@ -45,14 +141,15 @@ splash_window_init (SplashWindow *window)
 	gtk_window_set_skip_pager_hint (GTK_WINDOW (window), TRUE);
 	gtk_widget_set_app_paintable (GTK_WIDGET (window), TRUE);
 
-	GdkScreen *screen = gtk_window_get_screen (GTK_WINDOW (window));
-	if (gdk_screen_is_composited (screen)) {
-		GdkVisual *visual = gdk_screen_get_rgba_visual (screen);
-		if (visual == NULL)
-			visual = gdk_screen_get_system_visual (screen);
+	gtk_widget_set_visual (GTK_WIDGET (window), splash_window_get_visual (window, FALSE));
 
-		gtk_widget_set_visual (GTK_WIDGET(window), visual);
-	}
+	gtk_window_set_keep_above (GTK_WINDOW (window), TRUE);
+
+	g_signal_connect (G_OBJECT (window), "draw", G_CALLBACK (splash_window_draw_cb), NULL);
+
+	greeter_spinner_attach (window->priv->spinner);
+
+	greeter_profile_track_frames (GTK_WIDGET (window), "splash");
 }
 
 static void
@@ -81,39 +178,103 @@ splash_window_new (GtkWindow *parent)
 	return SPLASH_WINDOW (result);
 }
 
+/* The splash window is built once and kept realized while hidden;
+ * it is only moved when the active monitor changes. With @background,
+ * the monitor's wallpaper rendered at @scale_factor, or @color, the
+ * monitor's background colour, it is drawn opaque from a pre-dimmed
+ * copy instead of being blended over the wallpaper by the compositor. */
 void
-splash_window_show (SplashWindow *window)
+splash_window_set_monitor (SplashWindow       *window,
+                           GtkWindow          *parent,
+                           const GdkRectangle *geometry,
+                           gint                scale_factor,
+                           GdkPixbuf          *background,
+                           const GdkRGBA      *color)
+{
+	GdkVisual *visual;
+	GtkWidget *widget;
+	gboolean visible;
+
+	g_return_if_fail (SPLASH_IS_WINDOW (window));
+	g_return_if_fail (geometry != NULL);
+
+	widget = GTK_WIDGET (window);
+
+	gtk_window_set_transient_for (GTK_WINDOW (window), parent);
+
+	splash_window_set_backdrop (window, geometry, MAX (scale_factor, 1), background, color);
+
+	/* The visual can only be set while unrealized: the window is recreated
+	 * when moving between a monitor with a backdrop and one without */
+	visual = splash_window_get_visual (window, window->priv->backdrop != NULL);
+	if (visual != gtk_widget_get_visual (widget)) {
+		visible = gtk_widget_get_visible (widget);
+		if (visible)
+			gtk_widget_hide (widget);
+		if (gtk_widget_get_realized (widget))
+			gtk_widget_unrealize (widget);
+
+		gtk_widget_set_visual (widget, visual);
+
+		if (visible)
+			gtk_widget_show (widget);
+	}
+
+	gtk_widget_set_size_request (widget, geometry->width, geometry->height);
+	gtk_window_move (GTK_WINDOW (window), geometry->x, geometry->y);
+
+	gtk_widget_realize (widget);
+
+	window->priv->placed = TRUE;
+}
+
+/* Covers the primary monitor, or the first one, until a monitor is set */
+static void
+splash_window_place_on_primary (SplashWindow *window)
 {
-	gint m, monitors = 0;
 	GdkDisplay *display;
+	GdkMonitor *monitor;
 	GdkRectangle geometry;
 
+	display = gtk_widget_get_display (GTK_WIDGET (window));
+	monitor = gdk_display_get_primary_monitor (display);
+	if (!monitor)
+		monitor = gdk_display_get_monitor (display, 0);
+	if (!monitor)
+		return;
+
+	gdk_monitor_get_geometry (monitor, &geometry);
+	gtk_widget_set_size_request (GTK_WIDGET (window), geometry.width, geometry.height);
+	gtk_window_move (GTK_WINDOW (window), geometry.x, geometry.y);
+}
+
+void
+splash_window_show (SplashWindow *window)
+{
 	g_return_if_fail (SPLASH_IS_WINDOW (window));
 
-	display = gdk_display_get_default ();
-	monitors = gdk_display_get_n_monitors (display);
-	for (m = 0; m < monitors; m++) {
-		GdkMonitor *monitor = gdk_display_get_monitor (display, m);
-		if (gdk_monitor_is_primary (monitor)) {
-			gdk_monitor_get_geometry (monitor, &geometry);
-			gtk_widget_set_size_request (GTK_WIDGET (window), geometry.width, geometry.height);
-			gtk_window_move (GTK_WINDOW (window), geometry.x, geometry.y);
-			break;
-		}
-	}
+	if (!window->priv->placed)
+		splash_window_place_on_primary (window);
 
 //	gtk_spinner_start (GTK_SPINNER (window->priv->spinner));
 
-	gtk_window_set_keep_above (GTK_WINDOW (window), TRUE);
-	gtk_widget_show_all (GTK_WIDGET (window));
+	gtk_widget_show (GTK_WIDGET (window));
 }
 
 void
-splash_window_destroy (SplashWindow *window)
+splash_window_hide (SplashWindow *window)
 {
 	g_return_if_fail (SPLASH_IS_WINDOW (window));
 
 //	gtk_spinner_stop (GTK_SPINNER (window->priv->spinner));
 
+	gtk_widget_hide (GTK_WIDGET (window));
+}
+
+void
+splash_window_destroy (SplashWindow *window)
+{
+	g_return_if_fail (SPLASH_IS_WINDOW (window));
+
 	gtk_widget_destroy (GTK_WIDGET (window));
 }
@@ -42,7 +42,14 @@ GType          splash_window_get_type          (void); G_GNUC_CONST
 SplashWindow  *splash_window_new               (GtkWindow *parent);
 
 void           splash_window_show              (SplashWindow *window);
+void           splash_window_hide              (SplashWindow *window);
 void           splash_window_destroy           (SplashWindow *window);
+void           splash_window_set_monitor       (SplashWindow       *window,
+                                                GtkWindow          *parent,
+                                                const GdkRectangle *geometry,
+                                                gint                scale_factor,
+                                                GdkPixbuf          *background,
+                                                const GdkRGBA      *color);
 void           splash_window_set_message_label (SplashWindow *window,
                                                 const char   *message);
 
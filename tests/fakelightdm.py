@@ -0,0 +1,344 @@
+#
+# Copyright (C) 2015 - 2021 Gooroom <gooroom@gooroom.kr>
+#
+# This program is free software: you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later
+# version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+# license.
+#
+
+"""Stand-in for the LightDM daemon, speaking the greeter protocol.
+
+The greeter finds the daemon through the LIGHTDM_TO_SERVER_FD and
+LIGHTDM_FROM_SERVER_FD pipes. Every message is a header of two big-endian
+32-bit integers (message id, payload length) followed by the payload, made
+of big-endian integers and length-prefixed UTF-8 strings.
+
+Authentication is answered from a Scenario: a list of steps, each sending
+PAM messages and prompts and waiting for the greeter's answers, followed by
+the PAM result. Timestamps of what the greeter sent are recorded, so the
+harness can measure latencies from the daemon's side as well.
+"""
+
+import os
+import struct
+import threading
+import time
+
+# GreeterMessage
+GREETER_MESSAGE_CONNECT = 0
+GREETER_MESSAGE_AUTHENTICATE = 1
+GREETER_MESSAGE_AUTHENTICATE_AS_GUEST = 2
+GREETER_MESSAGE_CONTINUE_AUTHENTICATION = 3
+GREETER_MESSAGE_START_SESSION = 4
+GREETER_MESSAGE_CANCEL_AUTHENTICATION = 5
+GREETER_MESSAGE_SET_LANGUAGE = 6
+GREETER_MESSAGE_AUTHENTICATE_REMOTE = 7
+GREETER_MESSAGE_ENSURE_SHARED_DIR = 8
+
+# ServerMessage
+SERVER_MESSAGE_CONNECTED = 0
+SERVER_MESSAGE_PROMPT_AUTHENTICATION = 1
+SERVER_MESSAGE_END_AUTHENTICATION = 2
+SERVER_MESSAGE_SESSION_RESULT = 3
+SERVER_MESSAGE_SHARED_DIR_RESULT = 4
+
+# PAM message styles
+PAM_PROMPT_ECHO_OFF = 1
+PAM_PROMPT_ECHO_ON = 2
+PAM_ERROR_MSG = 3
+PAM_TEXT_INFO = 4
+
+# PAM results
+PAM_SUCCESS = 0
+PAM_AUTH_ERR = 7
+PAM_MAXTRIES = 11
+PAM_NEW_AUTHTOK_REQD = 12
+
+VERSION = "1.26.0"
+
+
+class Step:
+    """Messages sent in one PROMPT_AUTHENTICATION, as (style, text) pairs.
+
+    When the step contains prompts, the daemon waits for the greeter's
+    answers, which must equal `expect` if it is given.
+    """
+
+    def __init__(self, *messages, expect=None):
+        self.messages = list(messages)
+        self.expect = expect
+
+    @property
+    def n_prompts(self):
+        return sum(1 for style, _ in self.messages
+                   if style in (PAM_PROMPT_ECHO_OFF, PAM_PROMPT_ECHO_ON))
+
+
+class Scenario:
+    """A scripted PAM conversation.
+
+    `marker` is the start of the PAM message or prompt text the greeter
+    reacts to, which it logs as a profiling line; None for plain success.
+    """
+
+    def __init__(self, name, steps, result, marker=None, dismiss=False):
+        self.name = name
+        self.steps = steps
+        self.result = result
+        self.marker = marker
+        # The greeter shows a modal dialog that has to be confirmed
+        self.dismiss = dismiss
+
+
+def password_step(password):
+    return Step((PAM_PROMPT_ECHO_OFF, "Password: "), expect=[password])
+
+
+def scenarios(password):
+    """The PAM conversations of pam-gooroom and Linux-PAM the greeter handles"""
+    return [
+        Scenario("success",
+                 [password_step(password)],
+                 PAM_SUCCESS),
+        Scenario("password-expiry",
+                 [password_step(password),
+                  Step((PAM_TEXT_INFO, "You are required to change your password immediately (password expired)"),
+                       (PAM_PROMPT_ECHO_OFF, "Current password: "))],
+                 PAM_NEW_AUTHTOK_REQD,
+                 marker="You are required to change your password immediately"),
+        Scenario("duplicate-login",
+                 [password_step(password),
+                  Step((PAM_PROMPT_ECHO_ON, "Duplicate Login Notification:client-01:gooroom:10.0.0.2:192.168.0.2"),
+                       expect=["duplicate_login_ok"])],
+                 PAM_SUCCESS,
+                 marker="Duplicate Login Notification", dismiss=True),
+        Scenario("lockout",
+                 [password_step(password),
+                  Step((PAM_ERROR_MSG, "Account Locking"))],
+                 PAM_MAXTRIES,
+                 marker="Account Locking"),
+        Scenario("trial-warning",
+                 [password_step(password),
+                  Step((PAM_PROMPT_ECHO_ON, "Trial Period Warning:30:5"),
+                       expect=["trial_login_ok"])],
+                 PAM_SUCCESS,
+                 marker="Trial Period Warning", dismiss=True),
+    ]
+
+
+def failed_login(password):
+    """Used by the soak test to cycle through failed logins"""
+    return Scenario("failure",
+                    [password_step(password),
+                     Step((PAM_ERROR_MSG, "Authentication Failure:4"))],
+                    PAM_AUTH_ERR,
+                    marker="Authentication Failure")
+
+
+class ProtocolError(Exception):
+    pass
+
+
+class FakeLightDM:
+    """Serves one greeter connection from a thread"""
+
+    def __init__(self, hints=None):
+        self.hints = hints or {
+            "default-session": "gooroom",
+            "hide-users": "true",
+            "show-manual-login": "true",
+            "has-guest-account": "false",
+        }
+        # The greeter writes to_server, reads from_server
+        self.to_server_read, self.to_server_write = os.pipe()
+        self.from_server_read, self.from_server_write = os.pipe()
+        os.set_inheritable(self.to_server_write, True)
+        os.set_inheritable(self.from_server_read, True)
+
+        self.scenario = None
+        self.events = []            # (monotonic time, event name)
+        self.errors = []
+        self.session_started = threading.Event()
+        self.authentication_ended = threading.Event()
+        self._lock = threading.Lock()
+        self._thread = None
+        self._sequence = 0
+        self._username = None
+        self._steps = []
+        self._step = None
+
+    # The greeter's ends of the pipes
+    def greeter_env(self):
+        return {
+            "LIGHTDM_TO_SERVER_FD": str(self.to_server_write),
+            "LIGHTDM_FROM_SERVER_FD": str(self.from_server_read),
+        }
+
+    def greeter_fds(self):
+        return (self.to_server_write, self.from_server_read)
+
+    def start(self):
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def close_greeter_ends(self):
+        """Once the greeter is spawned, so EOF is seen when it exits"""
+        os.close(self.to_server_write)
+        os.close(self.from_server_read)
+
+    def set_scenario(self, scenario):
+        with self._lock:
+            self.scenario = scenario
+            self.session_started.clear()
+            self.authentication_ended.clear()
+
+    def event_time(self, name, after=0.0):
+        with self._lock:
+            for timestamp, event in self.events:
+                if event == name and timestamp >= after:
+                    return timestamp
+        return None
+
+    # Encoding
+
+    @staticmethod
+    def _int(value):
+        return struct.pack(">I", value)
+
+    @staticmethod
+    def _string(value):
+        data = (value or "").encode("utf-8")
+        return struct.pack(">I", len(data)) + data
+
+    def _send(self, message_id, payload):
+        os.write(self.from_server_write, struct.pack(">II", message_id, len(payload)) + payload)
+
+    def _read_exact(self, length):
+        data = b""
+        while len(data) < length:
+            chunk = os.read(self.to_server_read, length - len(data))
+            if not chunk:
+                raise EOFError
+            data += chunk
+        return data
+
+    # Decoding
+
+    class _Reader:
+        def __init__(self, payload):
+            self.payload = payload
+            self.offset = 0
+
+        def int(self):
+            if self.offset + 4 > len(self.payload):
+                raise ProtocolError("truncated integer")
+            value, = struct.unpack_from(">I", self.payload, self.offset)
+            self.offset += 4
+            return value
+
+        def string(self):
+            length = self.int()
+            if self.offset + length > len(self.payload):
+                raise ProtocolError("truncated string")
+            value = self.payload[self.offset:self.offset + length].decode("utf-8")
+            self.offset += length
+            return value
+
+    def _record(self, event):
+        with self._lock:
+            self.events.append((time.monotonic(), event))
+
+    def _run(self):
+        try:
+            while True:
+                header = self._read_exact(8)
+                message_id, length = struct.unpack(">II", header)
+                payload = self._read_exact(length) if length else b""
+                self._handle(message_id, self._Reader(payload))
+        except EOFError:
+            pass
+        except (ProtocolError, OSError) as error:
+            self.errors.append(str(error))
+
+    def _handle(self, message_id, reader):
+        if message_id == GREETER_MESSAGE_CONNECT:
+            reader.string()         # the greeter's version
+            self._record("connect")
+            payload = self._string(VERSION)
+            for name, value in self.hints.items():
+                payload += self._string(name) + self._string(value)
+            # Plain CONNECTED is understood by every liblightdm version
+            self._send(SERVER_MESSAGE_CONNECTED, payload)
+
+        elif message_id == GREETER_MESSAGE_AUTHENTICATE:
+            self._sequence = reader.int()
+            self._username = reader.string()
+            self._record("authenticate")
+            with self._lock:
+                scenario = self.scenario
+            self._steps = list(scenario.steps) if scenario else []
+            self._next_step()
+
+        elif message_id == GREETER_MESSAGE_CONTINUE_AUTHENTICATION:
+            n_secrets = reader.int()
+            secrets = [reader.string() for _ in range(n_secrets)]
+            self._record("continue")
+            step = self._step
+            if step and step.expect is not None and secrets != step.expect:
+                self.errors.append("%s: expected %r, got %r" %
+                                   (self.scenario.name, step.expect, secrets))
+                self._end(PAM_AUTH_ERR)
+                return
+            self._next_step()
+
+        elif message_id == GREETER_MESSAGE_CANCEL_AUTHENTICATION:
+            self._record("cancel")
+            self._steps = []
+            self._end(PAM_AUTH_ERR)
+
+        elif message_id == GREETER_MESSAGE_START_SESSION:
+            reader.string()         # the session
+            self._record("start-session")
+            self._send(SERVER_MESSAGE_SESSION_RESULT, self._int(0))
+            self.session_started.set()
+
+        elif message_id == GREETER_MESSAGE_SET_LANGUAGE:
+            reader.string()
+
+        elif message_id == GREETER_MESSAGE_ENSURE_SHARED_DIR:
+            username = reader.string()
+            self._send(SERVER_MESSAGE_SHARED_DIR_RESULT, self._string("/tmp/" + username))
+
+        elif message_id in (GREETER_MESSAGE_AUTHENTICATE_AS_GUEST,
+                            GREETER_MESSAGE_AUTHENTICATE_REMOTE):
+            # No guest or remote sessions here
+            self._sequence = reader.int()
+            self._end(PAM_AUTH_ERR)
+
+        else:
+            raise ProtocolError("unknown greeter message %d" % message_id)
+
+    def _next_step(self):
+        while self._steps:
+            self._step = self._steps.pop(0)
+            payload = self._int(self._sequence) + self._string(self._username)
+            payload += self._int(len(self._step.messages))
+            for style, text in self._step.messages:
+                payload += self._int(style) + self._string(text)
+            self._send(SERVER_MESSAGE_PROMPT_AUTHENTICATION, payload)
+            self._record("prompt")
+            if self._step.n_prompts:
+                return
+
+        self._step = None
+        with self._lock:
+            result = self.scenario.result if self.scenario else PAM_AUTH_ERR
+        self._end(result)
+
+    def _end(self, result):
+        payload = self._int(self._sequence) + self._string(self._username) + self._int(result)
+        self._send(SERVER_MESSAGE_END_AUTHENTICATION, payload)
+        self._record("end-authentication")
+        self.authentication_ended.set()